@@ -0,0 +1,68 @@
+// Block read time from a 64 channel memory with deep queues, with normal and with huge pages, in ns per block.
+// Huge pages need shmem_enabled set to advise (or always) in /sys/kernel/mm/transparent_hugepage.
+// g++ -std=c++11 -O2 -I../src hugepages.cpp -o hugepages -lpthread
+
+#include "SharedMemory.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+const int CHANNELS = 64;
+const int BUFFER_SIZE = 512;
+const int SLOTS = 256; // 32 MiB of float slots, channel after channel like AudioData
+const int READS = 200000;
+
+// reads a whole slot (every channel) from a random position, like a reader that is behind by a random lag
+double measure(bool hugePages, bool& isHugePages) {
+	size_t slotSize = (size_t)CHANNELS * BUFFER_SIZE;
+	int size = (int)(slotSize * SLOTS * sizeof(float));
+
+	SharedMemoryWriter writer;
+	writer.setHugePages(hugePages);
+	std::string name;
+	if (!writer.initUnique(size, name)) {
+		return 0;
+	}
+	float* memory = (float*)writer.getBuffer();
+	for (size_t i = 0; i < slotSize * SLOTS; i++) {
+		memory[i] = 1.0f;
+	}
+
+	SharedMemoryReader reader;
+	reader.setHugePages(hugePages);
+	if (!reader.open(name, size)) {
+		return 0;
+	}
+	isHugePages = reader.isHugePages();
+	const float* data = (const float*)reader.getBuffer();
+
+	std::mt19937 random(1);
+	std::vector<float> block(slotSize);
+	float sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < READS; r++) {
+		const float* slot = data + slotSize * (random() % SLOTS);
+		for (int c = 0; c < CHANNELS; c++) {
+			// a few frames of each channel, so the time goes to reaching the pages rather than copying
+			for (int i = 0; i < 16; i++) {
+				block[c * BUFFER_SIZE + i] = slot[c * BUFFER_SIZE + i];
+			}
+		}
+		sum += block[random() % CHANNELS * BUFFER_SIZE];
+	}
+	std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+	reader.close();
+	writer.close();
+	return sum > 0 ? time.count() / READS : 0;
+}
+
+int main() {
+	bool isHugePages = false;
+	double normal = measure(false, isHugePages);
+	double huge = measure(true, isHugePages);
+	printf("normal pages %.1f ns per block\n", normal);
+	printf("huge pages   %.1f ns per block (%s)\n", huge, isHugePages ? "backed by huge pages" : "not available, normal pages used");
+	return 0;
+}
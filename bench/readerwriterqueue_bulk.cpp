@@ -0,0 +1,81 @@
+// Per-element against bulk transfer through ReaderWriterQueue, in ns per sample.
+// g++ -std=c++11 -O2 -I../src readerwriterqueue_bulk.cpp -o readerwriterqueue_bulk -lpthread
+
+#include "readerwriterqueue/readerwriterqueue.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace moodycamel;
+
+const int BLOCK = 256;
+const int BLOCKS = 200000;
+
+template<typename Transfer>
+double measure(Transfer transfer) {
+	auto start = std::chrono::steady_clock::now();
+	transfer();
+	std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+	return time.count() / ((double)BLOCK * BLOCKS);
+}
+
+// producer and consumer in one thread, block by block
+double sameThread(bool bulk) {
+	ReaderWriterQueue<float> queue(BLOCK * 4);
+	std::vector<float> in(BLOCK, 0.5f), out(BLOCK);
+	return measure([&]() {
+		for (int b = 0; b < BLOCKS; b++) {
+			if (bulk) {
+				queue.try_enqueue_bulk(in.data(), BLOCK);
+				queue.try_dequeue_bulk(out.data(), BLOCK);
+			}
+			else {
+				for (int i = 0; i < BLOCK; i++) {
+					queue.try_enqueue(in[i]);
+				}
+				for (int i = 0; i < BLOCK; i++) {
+					queue.try_dequeue(out[i]);
+				}
+			}
+		}
+	});
+}
+
+// like the reader thread feeding an audio callback
+double twoThreads(bool bulk) {
+	ReaderWriterQueue<float> queue(BLOCK * 4);
+	return measure([&]() {
+		std::thread producer([&]() {
+			std::vector<float> in(BLOCK, 0.5f);
+			for (int b = 0; b < BLOCKS; b++) {
+				size_t done = 0;
+				while (done < (size_t)BLOCK) {
+					size_t n = bulk ? queue.try_enqueue_bulk(in.data() + done, BLOCK - done) : queue.try_enqueue(in[done]);
+					if (n == 0) {
+						std::this_thread::yield();
+					}
+					done += n;
+				}
+			}
+		});
+		std::vector<float> out(BLOCK);
+		size_t total = (size_t)BLOCK * BLOCKS;
+		size_t done = 0;
+		while (done < total) {
+			size_t n = bulk ? queue.try_dequeue_bulk(out.data(), BLOCK) : queue.try_dequeue(out[done % BLOCK]);
+			if (n == 0) {
+				std::this_thread::yield();
+			}
+			done += n;
+		}
+		producer.join();
+	});
+}
+
+int main() {
+	printf("same thread:  per-element %.2f ns, bulk %.2f ns\n", sameThread(false), sameThread(true));
+	printf("two threads:  per-element %.2f ns, bulk %.2f ns\n", twoThreads(false), twoThreads(true));
+	return 0;
+}
@@ -292,11 +292,13 @@ void ofApp::audioOut(ofSoundBuffer & buffer) {
 	}
 
 	// write
-	float* dataWrite = audioSender.getDataPointer();
-	for (int i = 0; i < bufferSize; i++) {
-		dataWrite[i] = lAudio[i];
+	float* dataWrite = audioSender.beginWrite();
+	if (dataWrite != nullptr) {
+		for (int i = 0; i < bufferSize; i++) {
+			dataWrite[i] = lAudio[i];
+		}
+		audioSender.commitWrite(bufferSize);
 	}
-	audioSender.writeData();
 #else 
 
 	map<string, AudioSenderConnection*> audioSenderConnections = audioReceiver.getAudioClientConnections();
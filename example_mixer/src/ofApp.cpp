@@ -194,22 +194,19 @@ void ofApp::audioOut(ofSoundBuffer & buffer) {
 					audioSenderConnection->sendData(io::to_json(MIXER_STATE{ 1.123 }));
 
 					float vol = 0;
-					int size = audioSenderConnection->audioQueue.size_approx();
-					//cout << ">> size: " << size << endl;
-					if (size > audioSenderConnection->channels * bufferSize) {
-						for (int j = 0; j < bufferSize; j++) {
-							for (int i = 0; i < audioSenderConnection->channels; i++) {
-								if (!audioSenderConnection->audioQueue.try_dequeue(sample)) {
-									cout << "not valid" << endl;
-									//valid = false;
-									break;
-								}
-
-								// use only first 2 channels
-								if (i < 2) {
-									buffer[j*channels + i] += sample;
-									vol += fabs(sample);
-								}
+					int frames = audioSenderConnection->audioQueue.getAvailableFrames();
+					//cout << ">> frames: " << frames << endl;
+					if (frames > bufferSize) {
+						// the channels can change with the format of the sender, read tells them
+						int senderChannels = 0;
+						senderAudio.resize(bufferSize * audioSenderConnection->audioQueue.getMaxChannels());
+						int senderFrames = audioSenderConnection->audioQueue.read(senderAudio.data(), bufferSize, senderChannels);
+						for (int j = 0; j < senderFrames; j++) {
+							// use only first 2 channels
+							for (int i = 0; i < senderChannels && i < 2; i++) {
+								sample = senderAudio[j*senderChannels + i];
+								buffer[j*channels + i] += sample;
+								vol += fabs(sample);
 							}
 						}
 					}
@@ -224,11 +221,7 @@ void ofApp::audioOut(ofSoundBuffer & buffer) {
 				}
 				else {
 					// skip sender data ?
-					for (int i = 0; i < audioSenderConnection->channels ; i++) {
-						for (int j = 0; j < bufferSize; j++) {
-							audioSenderConnection->audioQueue.try_dequeue(sample);
-						}
-					}
+					audioSenderConnection->audioQueue.skip(bufferSize);
 				}
 			}
 		}
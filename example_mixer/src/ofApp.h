@@ -49,4 +49,5 @@ public:
 
 	vector <float> lAudio;
 	vector <float> rAudio;
+	vector <float> senderAudio;
 };
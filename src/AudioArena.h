@@ -0,0 +1,193 @@
+#pragma once
+
+#include "SharedMemory.h"
+#include "AudioMemoryHeader.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <string.h>
+#include <stdint.h>
+
+const uint32_t AUDIOARENA_MAGIC = 0x5241444D; // "MDAR"
+const uint32_t AUDIOARENA_VERSION = 1;
+
+// First bytes of an arena, the streams follow page aligned.
+struct AudioArenaHeader {
+	uint32_t magic; // AUDIOARENA_MAGIC once the rest is valid
+	uint32_t version; // AUDIOARENA_VERSION
+	uint64_t size; // bytes of the whole arena
+	int32_t pid; // process of the writer
+	int32_t reserved[11];
+
+	static AudioArenaHeader* get(char* buf) {
+		return reinterpret_cast<AudioArenaHeader*>(buf);
+	}
+
+	bool isValid() {
+		return reinterpret_cast<std::atomic<uint32_t>*>(&magic)->load(std::memory_order_acquire) == AUDIOARENA_MAGIC && version == AUDIOARENA_VERSION;
+	}
+};
+
+static_assert(sizeof(AudioArenaHeader) == 64, "AudioArenaHeader is shared between processes, keep its size fixed");
+
+// One shared memory holding the streams of many senders of a process (AudioSender::arena), so receivers map
+// it once instead of a memory per stream. Every stream gets a page aligned range laid out exactly like
+// its own memory would be (AudioMemoryHeader first) and is named "<arena>@<offset>".
+// Ranges are handed out from the top of the arena, released ones are reused by streams that fit in them
+// once receivers had time to notice the stream is gone.
+class AudioArena {
+	struct Range {
+		size_t offset;
+		size_t size;
+		bool isUsed;
+		std::chrono::steady_clock::time_point releaseTime;
+	};
+
+	SharedMemoryWriter sharedMemory;
+	std::vector<Range> ranges;
+	size_t sizeUsed = 0;
+	std::mutex mutex;
+
+public:
+	std::string nameSharedMemory;
+	bool hugePages = false; // back the arena with transparent huge pages if possible (Linux)
+	bool lockMemory = false; // keep the arena in RAM for real-time use, see SharedMemoryBase::setLocked
+
+	~AudioArena() {
+		close();
+	}
+
+	// size - bytes for all streams together
+	bool init(int size) {
+		close();
+		size_t sizeArena = AudioMemoryHeader::align(getDataOffset() + size, SharedMemoryBase::getPageSize());
+		sharedMemory.setHugePages(hugePages);
+		sharedMemory.setLocked(lockMemory);
+		if (!sharedMemory.initUnique((int)sizeArena, nameSharedMemory)) {
+			std::cout << "Error while open the audio arena!" << std::endl;
+			return false;
+		}
+
+		AudioArenaHeader* header = AudioArenaHeader::get(sharedMemory.getBuffer());
+		header->version = AUDIOARENA_VERSION;
+		header->size = sizeArena;
+		header->pid = SharedMemoryBase::getProcessId();
+		reinterpret_cast<std::atomic<uint32_t>*>(&header->magic)->store(AUDIOARENA_MAGIC, std::memory_order_release);
+
+		sizeUsed = getDataOffset();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lock(mutex);
+		sharedMemory.close();
+		ranges.clear();
+		sizeUsed = 0;
+	}
+
+	bool isOpened() {
+		return sharedMemory.isOpened();
+	}
+
+	static size_t getDataOffset() {
+		return SharedMemoryBase::getPageSize();
+	}
+
+	// Makes view a cleared range of size bytes inside the arena and returns its name for receivers,
+	// empty if the arena is full. Give the view back with release.
+	std::string allocate(int size, SharedMemoryWriter& view) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!sharedMemory.isOpened()) {
+			return "";
+		}
+		size_t sizeRange = AudioMemoryHeader::align(size, SharedMemoryBase::getPageSize());
+		std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+
+		Range* range = nullptr;
+		for (auto& r : ranges) {
+			if (!r.isUsed && r.size >= sizeRange && time - r.releaseTime > std::chrono::seconds(1)) {
+				range = &r;
+				break;
+			}
+		}
+		if (range == nullptr) {
+			if (sizeUsed + sizeRange > (size_t)sharedMemory.getSize()) {
+				std::cout << "The audio arena is full!" << std::endl;
+				return "";
+			}
+			ranges.push_back({ sizeUsed, sizeRange, false, time });
+			sizeUsed += sizeRange;
+			range = &ranges.back();
+		}
+		range->isUsed = true;
+
+		memset(sharedMemory.getBuffer() + range->offset, 0, range->size);
+		view.initView(sharedMemory, range->offset, size);
+		return nameSharedMemory + "@" + std::to_string(range->offset);
+	}
+
+	void release(SharedMemoryWriter& view) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!view.isOpened() || !sharedMemory.isOpened()) {
+			return;
+		}
+		size_t offset = view.getBuffer() - sharedMemory.getBuffer();
+		for (auto& r : ranges) {
+			if (r.offset == offset && r.isUsed) {
+				// receivers still reading it see the stream is gone
+				reinterpret_cast<std::atomic<uint32_t>*>(&AudioMemoryHeader::get(view.getBuffer())->magic)->store(0, std::memory_order_release);
+				r.isUsed = false;
+				r.releaseTime = std::chrono::steady_clock::now();
+				break;
+			}
+		}
+		view.close();
+	}
+
+	// splits "<arena>@<offset>", false for the name of a memory of its own
+	static bool parseStreamName(const std::string& nameStream, std::string& nameArena, size_t& offset) {
+		size_t pos = nameStream.rfind('@');
+		if (pos == std::string::npos || pos + 1 == nameStream.size()) {
+			return false;
+		}
+		nameArena = nameStream.substr(0, pos);
+		offset = std::stoull(nameStream.substr(pos + 1));
+		return true;
+	}
+
+	// for receivers: maps every arena once per process, the mapping lives while a stream of it is open
+	static std::shared_ptr<SharedMemoryReader> open(const std::string& nameArena, bool hugePages = false, bool lockMemory = false) {
+		static std::mutex mutexArenas;
+		static std::map<std::string, std::weak_ptr<SharedMemoryReader>> arenas;
+
+		std::lock_guard<std::mutex> lock(mutexArenas);
+		std::shared_ptr<SharedMemoryReader> arena = arenas[nameArena].lock();
+		if (arena && AudioArenaHeader::get(arena->getBuffer())->isValid()) {
+			return arena;
+		}
+
+		SharedMemoryReader headerReader;
+		if (!headerReader.open(nameArena, sizeof(AudioArenaHeader))) {
+			return nullptr;
+		}
+		AudioArenaHeader* header = AudioArenaHeader::get(headerReader.getBuffer());
+		if (!header->isValid()) {
+			std::cout << "The audio arena has an unknown version!" << std::endl;
+			return nullptr;
+		}
+		int size = (int)header->size;
+		headerReader.close();
+
+		arena = std::make_shared<SharedMemoryReader>();
+		arena->setHugePages(hugePages);
+		arena->setLocked(lockMemory);
+		if (!arena->open(nameArena, size)) {
+			return nullptr;
+		}
+		arenas[nameArena] = arena;
+		return arena;
+	}
+};
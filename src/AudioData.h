@@ -1,10 +1,21 @@
 #pragma once
 
 #include "SharedMemory.h"
+#include "AudioMemoryHeader.h"
+#include "AudioSampleFormat.h"
 #include "readerwriterqueue/readerwriterqueue.h"
 
+#include <atomic>
+#include <stdint.h>
+
 const int PORT_MEMORYSHARING = 2040;
 
+// Memory layout: AudioMemoryHeader; cache line written by the writer: index of the newest slot, 32-bit notify counter,
+// 64-bit count of published blocks; cache line written by readers: number of readers waiting on the notify counter;
+// AUDIOMEMORY_READERS reader positions (AudioMemoryReader); per slot a 32-bit sequence counter (padded to 8 bytes) and the 64-bit number of the block it holds; slots aligned
+// to a cache line (to a page when a slot is at least a page big).
+// A sequence counter is odd while its slot is being written and is increased again when the slot is published,
+// so readers can detect torn reads without locks (seqlock). Block numbers let readers consume every block in order.
 class AudioData {
 public:
 	int DATABUFFER_SIZE;
@@ -12,12 +23,22 @@ public:
 	int n;
 	vector<vector<float>> data;
 
-	void init(int DATABUFFER_SIZE, int DATABUFFERS_COUNT) {
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "lock-free 32-bit atomics are required for shared memory");
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "lock-free 64-bit atomics are required for shared memory");
+
+	// allocateData - keep a local copy of the slots, not needed for zero-copy reading and writing
+	void init(int DATABUFFER_SIZE, int DATABUFFERS_COUNT, bool allocateData = true) {
 		n = 0;
 
 		this->DATABUFFER_SIZE = DATABUFFER_SIZE;
 		this->DATABUFFERS_COUNT = DATABUFFERS_COUNT;
 
+		data.clear();
+		data.shrink_to_fit();
+		if (!allocateData) {
+			return;
+		}
+
 		data.resize(DATABUFFERS_COUNT);
 		for (size_t i = 0; i < data.size(); i++) {
 			data[i].resize(DATABUFFER_SIZE);
@@ -28,29 +49,214 @@ public:
         return n < data.size() ? data[n].data() : nullptr;
 	}
 
+	// called by the writer right after the memory is created
+	void writeHeader(char* buf, int channels, int sampleRate) {
+		AudioMemoryHeader* header = AudioMemoryHeader::get(buf);
+		header->layout = (int)AudioLayout::Slots;
+		header->format = (int)AudioSampleFormat::Float32;
+		header->channels = channels;
+		header->sampleRate = sampleRate;
+		header->bufferSize = DATABUFFER_SIZE / channels;
+		header->memoryQueueSize = DATABUFFERS_COUNT;
+		header->size = getSize();
+		header->controlOffset = AudioMemoryHeader::getControlOffset();
+		header->dataOffset = getDataOffset(0);
+		header->dataStride = getSlotStride();
+		header->publish();
+	}
+
+	// true if the memory was written by a compatible writer with the same layout
+	bool checkHeader(char* buf) {
+		AudioMemoryHeader* header = AudioMemoryHeader::get(buf);
+		return header->isValid() && header->layout == (int)AudioLayout::Slots && header->format == (int)AudioSampleFormat::Float32 && header->size == getSize() &&
+			header->dataOffset == getDataOffset(0) && header->dataStride == getSlotStride();
+	}
+
 	size_t getSize() {
-		return (sizeof(float) * DATABUFFER_SIZE * DATABUFFERS_COUNT + 3 * sizeof(int));
+		return getDataOffset(DATABUFFERS_COUNT);
+	}
+
+	size_t getIndexOffset() {
+		return AudioMemoryHeader::getControlOffset();
+	}
+
+	size_t getNotifyOffset() {
+		return getIndexOffset() + sizeof(int);
+	}
+
+	size_t getBlocksWrittenOffset() {
+		return getIndexOffset() + sizeof(uint64_t);
+	}
+
+	size_t getWaitersOffset() {
+		return getIndexOffset() + AUDIOMEMORY_CACHE_LINE;
+	}
+
+	size_t getReadersOffset() {
+		return getIndexOffset() + 2 * AUDIOMEMORY_CACHE_LINE;
+	}
+
+	size_t getSequenceOffset(int idx) {
+		return getReadersOffset() + AudioMemoryReaders::getSize() + 2 * sizeof(uint64_t) * idx;
+	}
+
+	size_t getBlockOffset(int idx) {
+		return getSequenceOffset(idx) + sizeof(uint64_t);
+	}
+
+	size_t getSlotAlignment() {
+		return sizeof(float) * DATABUFFER_SIZE >= AUDIOMEMORY_PAGE ? AUDIOMEMORY_PAGE : AUDIOMEMORY_CACHE_LINE;
+	}
+
+	size_t getSlotStride() {
+		return AudioMemoryHeader::align(sizeof(float) * DATABUFFER_SIZE, getSlotAlignment());
+	}
+
+	size_t getDataOffset(int idx) {
+		return AudioMemoryHeader::align(getSequenceOffset(DATABUFFERS_COUNT), getSlotAlignment()) + getSlotStride() * idx;
+	}
+
+	std::atomic<int>* getIndex(char* buf) {
+		return reinterpret_cast<std::atomic<int>*>(buf + getIndexOffset());
+	}
+
+	// increased by the writer with every published block, readers sleep on it
+	std::atomic<uint32_t>* getNotify(char* buf) {
+		return reinterpret_cast<std::atomic<uint32_t>*>(buf + getNotifyOffset());
+	}
+
+	std::atomic<uint32_t>* getWaiters(char* buf) {
+		return reinterpret_cast<std::atomic<uint32_t>*>(buf + getWaitersOffset());
+	}
+
+	std::atomic<uint64_t>* getBlocksWritten(char* buf) {
+		return reinterpret_cast<std::atomic<uint64_t>*>(buf + getBlocksWrittenOffset());
+	}
+
+	std::atomic<uint32_t>* getSequence(char* buf, int idx) {
+		return reinterpret_cast<std::atomic<uint32_t>*>(buf + getSequenceOffset(idx));
+	}
+
+	std::atomic<uint64_t>* getBlock(char* buf, int idx) {
+		return reinterpret_cast<std::atomic<uint64_t>*>(buf + getBlockOffset(idx));
 	}
 };
 
+// Reads the blocks one after another. If the writer gets more than DATABUFFERS_COUNT blocks ahead, the lost blocks
+// are counted in overruns and reading continues from the oldest block still in memory.
 class AudioDataReader {
 public:
 	int idxRead = -1;
+	uint64_t blockRead = 0; // next block to read
+	bool isAttached = false;
+	int readerIndex = -1; // entry in the reader positions, -1 when all were taken
+	uint32_t sequenceRead = 0;
+	uint32_t notifyRead = 0;
+	int tornReads = 0;
+	int overruns = 0;
 	vector<float> resampledData;
 
 
 	bool readFromMemory(SharedMemoryReader& sharedMemoryReader, AudioData& audioData) {
-		bool success = false;
+		const float* slot = beginRead(sharedMemoryReader, audioData);
+		if (slot == nullptr) {
+			return false;
+		}
+
+		memcpy(audioData.data[idxRead].data(), slot, sizeof(float) * audioData.DATABUFFER_SIZE);
+
+		return endRead(sharedMemoryReader, audioData);
+	}
+
+	// zero-copy path: returns the next unread slot inside the shared memory or nullptr when there is nothing new,
+	// the data must be consumed before endRead is called
+	const float* beginRead(SharedMemoryReader& sharedMemoryReader, AudioData& audioData) {
+		if (!sharedMemoryReader.isOpened()) {
+			return nullptr;
+		}
+		char* buf = sharedMemoryReader.getBuffer();
+
+		// remember the counter before looking for data, so a block published meanwhile wakes up waitForData
+		notifyRead = audioData.getNotify(buf)->load(std::memory_order_acquire);
+
+		while (true) {
+			uint64_t blocksWritten = audioData.getBlocksWritten(buf)->load(std::memory_order_acquire);
+			if (!isAttached) {
+				if (blocksWritten == 0) {
+					return nullptr;
+				}
+				// start from the newest block
+				blockRead = blocksWritten - 1;
+				isAttached = true;
+				readerIndex = AudioMemoryReaders::attach(buf, audioData.getReadersOffset(), blockRead);
+			}
+			if (blockRead >= blocksWritten) {
+				return nullptr;
+			}
+			if (blocksWritten - blockRead > (uint64_t)audioData.DATABUFFERS_COUNT) {
+				overruns += blocksWritten - blockRead - audioData.DATABUFFERS_COUNT;
+				blockRead = blocksWritten - audioData.DATABUFFERS_COUNT;
+			}
+
+			int idx = blockRead % audioData.DATABUFFERS_COUNT;
+			sequenceRead = audioData.getSequence(buf, idx)->load(std::memory_order_acquire);
+			if ((sequenceRead & 1) == 0 && audioData.getBlock(buf, idx)->load(std::memory_order_relaxed) == blockRead) {
+				audioData.n = idx;
+				idxRead = idx;
+				return (const float*)(buf + audioData.getDataOffset(idx));
+			}
+
+			// the writer is already rewriting this slot with a newer block
+			overruns++;
+			blockRead++;
+		}
+	}
+
+	// returns false if the writer has touched the slot since beginRead, the block is lost then
+	bool endRead(SharedMemoryReader& sharedMemoryReader, AudioData& audioData) {
+		char* buf = sharedMemoryReader.getBuffer();
+		std::atomic_thread_fence(std::memory_order_acquire);
+		blockRead++;
+		bool valid = audioData.getSequence(buf, idxRead)->load(std::memory_order_relaxed) == sequenceRead;
+		if (!valid) {
+			tornReads++;
+			overruns++;
+		}
+		AudioMemoryReaders::update(buf, audioData.getReadersOffset(), readerIndex, blockRead, overruns);
+		return valid;
+	}
+
+	// gives the reader position back, call before the memory is closed
+	void detach(SharedMemoryReader& sharedMemoryReader, AudioData& audioData) {
 		if (sharedMemoryReader.isOpened()) {
-			sharedMemoryReader.update((char*)&(audioData.n), 2 * sizeof(int), sizeof(int));
-			if (idxRead == -1 || idxRead != audioData.n) {
-				idxRead = audioData.n;
-				sharedMemoryReader.update((char*)(audioData.data[idxRead].data()), 3 * sizeof(int) + sizeof(float) * audioData.DATABUFFER_SIZE * idxRead, sizeof(float) * audioData.DATABUFFER_SIZE);
+			AudioMemoryReaders::detach(sharedMemoryReader.getBuffer(), audioData.getReadersOffset(), readerIndex);
+		}
+		readerIndex = -1;
+		isAttached = false;
+	}
+
+	// call when beginRead returned nothing: spins spinCount times, then sleeps until the writer
+	// publishes the next block or timeoutMicros pass
+	void waitForData(SharedMemoryReader& sharedMemoryReader, AudioData& audioData, int timeoutMicros, int spinCount = 0) {
+		if (!sharedMemoryReader.isOpened()) {
+			std::this_thread::sleep_for(std::chrono::microseconds(timeoutMicros));
+			return;
+		}
+		char* buf = sharedMemoryReader.getBuffer();
+		std::atomic<uint32_t>* notify = audioData.getNotify(buf);
+		AudioMemoryReaders::heartbeat(buf, audioData.getReadersOffset(), readerIndex);
 
-				success = true;
+		for (int i = 0; i < spinCount; i++) {
+			if (notify->load(std::memory_order_acquire) != notifyRead) {
+				return;
 			}
+			std::this_thread::yield();
 		}
-		return success;
+
+		std::atomic<uint32_t>* waiters = audioData.getWaiters(buf);
+		waiters->fetch_add(1);
+		SharedMemoryNotify::wait(notify, notifyRead, timeoutMicros);
+		waiters->fetch_sub(1);
 	}
 
 };
@@ -58,24 +264,79 @@ public:
 class AudioDataWriter {
 public:
 	int idxWrite = 0;
+	uint64_t blockWrite = 0;
+	bool flowControl = false; // never overwrite a block an active reader hasn't read yet, beginWrite fails instead
+
+	// blocks not yet consumed by the slowest active reader
+	int getQueuedBlocks(SharedMemoryWriter& sharedMemoryWriter, AudioData& audioData, int* readersCount = nullptr) {
+		if (!sharedMemoryWriter.isOpened()) {
+			return 0;
+		}
+		uint64_t lag = AudioMemoryReaders::getSlowestLag(sharedMemoryWriter.getBuffer(), audioData.getReadersOffset(), blockWrite, readersCount);
+		return (int)std::min<uint64_t>(lag, audioData.DATABUFFERS_COUNT);
+	}
 
 	bool writeToMemory(SharedMemoryWriter& sharedMemoryWriter, AudioData& audioData) {
-		bool success = false;
+		float* slot = beginWrite(sharedMemoryWriter, audioData);
+		if (slot == nullptr) {
+			return false;
+		}
 
-		if (sharedMemoryWriter.isOpened()) {
-			sharedMemoryWriter.update((char*)(audioData.data[idxWrite].data()), 3 * sizeof(int) + sizeof(float) * audioData.DATABUFFER_SIZE * idxWrite, sizeof(float) * audioData.DATABUFFER_SIZE);
+		memcpy(slot, audioData.data[idxWrite].data(), sizeof(float) * audioData.DATABUFFER_SIZE);
 
-			//cout << "write: " << n << endl;
+		//cout << "write: " << n << endl;
 
-			audioData.n = idxWrite;
-			sharedMemoryWriter.update((char*)&(audioData.n), 2 * sizeof(int), sizeof(int));
+		return commitWrite(sharedMemoryWriter, audioData);
+	}
 
-			idxWrite = audioData.n + 1 >= audioData.DATABUFFERS_COUNT ? 0 : audioData.n + 1;
+	// zero-copy path: fill the returned slot in place, then call commitWrite
+	float* beginWrite(SharedMemoryWriter& sharedMemoryWriter, AudioData& audioData) {
+		if (!sharedMemoryWriter.isOpened()) {
+			return nullptr;
+		}
+		char* buf = sharedMemoryWriter.getBuffer();
+
+		if (flowControl && getQueuedBlocks(sharedMemoryWriter, audioData) >= audioData.DATABUFFERS_COUNT) {
+			return nullptr;
+		}
 
-			success = true;
+		// mark the slot as being written (odd) before any data is touched
+		std::atomic<uint32_t>* sequence = audioData.getSequence(buf, idxWrite);
+		uint32_t value = sequence->load(std::memory_order_relaxed);
+		if ((value & 1) == 0) {
+			sequence->store(value + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
 		}
 
-		return success;
+		return (float*)(buf + audioData.getDataOffset(idxWrite));
 	}
-};
 
+	bool commitWrite(SharedMemoryWriter& sharedMemoryWriter, AudioData& audioData) {
+		if (!sharedMemoryWriter.isOpened()) {
+			return false;
+		}
+		char* buf = sharedMemoryWriter.getBuffer();
+
+		audioData.getBlock(buf, idxWrite)->store(blockWrite, std::memory_order_relaxed);
+
+		// back to even, also when beginWrite was not called for this slot
+		std::atomic<uint32_t>* sequence = audioData.getSequence(buf, idxWrite);
+		sequence->store((sequence->load(std::memory_order_relaxed) | 1) + 1, std::memory_order_release);
+
+		blockWrite++;
+		audioData.getBlocksWritten(buf)->store(blockWrite, std::memory_order_release);
+
+		audioData.n = idxWrite;
+		audioData.getIndex(buf)->store(audioData.n, std::memory_order_release);
+
+		// the syscall is only made when a reader sleeps
+		audioData.getNotify(buf)->fetch_add(1);
+		if (audioData.getWaiters(buf)->load() > 0) {
+			SharedMemoryNotify::wake(audioData.getNotify(buf));
+		}
+
+		idxWrite = audioData.n + 1 >= audioData.DATABUFFERS_COUNT ? 0 : audioData.n + 1;
+
+		return true;
+	}
+};
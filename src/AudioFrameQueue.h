@@ -0,0 +1,218 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+
+// what AudioFrameQueue does with frames that don't fit
+enum class AudioQueueOverflow : int {
+	DropNewest = 0, // write what fits, the rest is dropped
+	DropOldest = 1, // the producer discards the oldest frames to make room, keeps the latency bounded
+	Signal = 2, // write nothing, the producer gets 0 and decides itself (e.g. waits for room)
+};
+
+// Fixed-capacity queue of interleaved float frames between one producer and one consumer thread,
+// e.g. the reader thread of AudioReceiverConnection and the audio callback. Whole blocks are copied with memcpy
+// and published with one release store, instead of one atomic operation per sample.
+// Nothing is allocated after init, whatever the overflow policy: the memory is sized for maxChannels,
+// so the producer can change the channel count (setChannels) while the consumer reads.
+class AudioFrameQueue {
+	std::vector<float> data;
+	int maxChannels = 0;
+	int capacity = 0; // frames
+	AudioQueueOverflow overflow = AudioQueueOverflow::DropNewest;
+
+	std::atomic<int> channels{ 0 }; // of the queued frames, changed by the producer
+	alignas(64) std::atomic<uint64_t> frameWrite{ 0 }; // written by the producer
+	alignas(64) std::atomic<uint64_t> frameRead{ 0 }; // written by the consumer, and by the producer to drop frames
+	std::atomic<uint64_t> droppedFrames{ 0 };
+
+	// producer: how many of count frames are written at w, skip - how many leading frames of the input are dropped
+	int reserve(uint64_t w, int count, int& skip) {
+		skip = 0;
+		uint64_t r = frameRead.load(std::memory_order_acquire);
+		int space = capacity - (int)(w - r);
+		if (count <= space) {
+			return count;
+		}
+		if (overflow == AudioQueueOverflow::Signal) {
+			return 0;
+		}
+		if (overflow == AudioQueueOverflow::DropNewest) {
+			count = std::max(space, 0);
+			return count;
+		}
+
+		// DropOldest: only the last capacity frames of the input can stay
+		if (count > capacity) {
+			skip = count - capacity;
+			count = capacity;
+			droppedFrames.fetch_add(skip, std::memory_order_relaxed);
+		}
+		drop(w + count - capacity);
+		return count;
+	}
+
+	// producer: moves the consumer on to next before its frames are overwritten, it retries a read that raced with this
+	void drop(uint64_t next) {
+		uint64_t r = frameRead.load(std::memory_order_acquire);
+		while (r < next && !frameRead.compare_exchange_weak(r, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+		}
+		if (r < next) {
+			droppedFrames.fetch_add(next - r, std::memory_order_relaxed);
+		}
+	}
+
+public:
+	// not thread safe, call before the producer and the consumer start
+	void init(int maxChannels, int capacity, AudioQueueOverflow overflow = AudioQueueOverflow::DropNewest) {
+		this->maxChannels = maxChannels;
+		this->capacity = capacity;
+		this->overflow = overflow;
+		data.assign((size_t)maxChannels * capacity, 0.0f);
+		channels.store(maxChannels);
+		frameWrite.store(0);
+		frameRead.store(0);
+	}
+
+	// producer: frames written from now on have channels channels, the queued ones are dropped.
+	// False if channels is more than the queue was made for.
+	bool setChannels(int channels) {
+		if (channels < 1 || channels > maxChannels) {
+			return false;
+		}
+		if (channels != this->channels.load(std::memory_order_relaxed)) {
+			// dropped first: a consumer that sees the new count has lost the old frames, it fails to release them and retries
+			drop(frameWrite.load(std::memory_order_relaxed));
+			this->channels.store(channels, std::memory_order_release);
+		}
+		return true;
+	}
+
+	// channels of the frames the producer writes, the consumer gets the count of what it read from read
+	int getChannels() {
+		return channels.load(std::memory_order_acquire);
+	}
+
+	// buffers given to read need count * getMaxChannels() floats
+	int getMaxChannels() {
+		return maxChannels;
+	}
+
+	int getCapacity() {
+		return capacity;
+	}
+
+	AudioQueueOverflow getOverflow() {
+		return overflow;
+	}
+
+	// frames the consumer can read
+	int getAvailableFrames() {
+		uint64_t r = frameRead.load(std::memory_order_acquire);
+		return std::min((int)(frameWrite.load(std::memory_order_acquire) - r), capacity);
+	}
+
+	// frames lost with DropNewest or DropOldest, or queued when the channels changed, since the queue was created
+	uint64_t getDroppedFrames() {
+		return droppedFrames.load(std::memory_order_relaxed);
+	}
+
+	// producer: appends up to frames interleaved frames, returns how many were written,
+	// commit - false to publish them later with commitWrite, e.g. once the source is known to be valid
+	int write(const float* frames, int count, bool commit = true) {
+		uint64_t w = frameWrite.load(std::memory_order_relaxed);
+		int skip;
+		int written = reserve(w, count, skip);
+		if (overflow == AudioQueueOverflow::DropNewest) {
+			droppedFrames.fetch_add(count - written, std::memory_order_relaxed);
+		}
+		if (written <= 0) {
+			return 0;
+		}
+		int channels = this->channels.load(std::memory_order_relaxed);
+		frames += (size_t)skip * channels;
+		int pos = (int)(w % capacity);
+		int first = std::min(written, capacity - pos);
+		memcpy(&data[(size_t)pos * channels], frames, sizeof(float) * first * channels);
+		memcpy(&data[0], frames + (size_t)first * channels, sizeof(float) * (written - first) * channels);
+		if (commit) {
+			frameWrite.store(w + written, std::memory_order_release);
+		}
+		return written;
+	}
+
+	// producer: like write for planar input, channel c starts at frames + c * channelStride and is interleaved on the copy
+	int writePlanar(const float* frames, int channelStride, int count, bool commit = true) {
+		uint64_t w = frameWrite.load(std::memory_order_relaxed);
+		int skip;
+		int written = reserve(w, count, skip);
+		if (overflow == AudioQueueOverflow::DropNewest) {
+			droppedFrames.fetch_add(count - written, std::memory_order_relaxed);
+		}
+		if (written <= 0) {
+			return 0;
+		}
+		int channels = this->channels.load(std::memory_order_relaxed);
+		int pos = (int)(w % capacity);
+		int first = std::min(written, capacity - pos);
+		for (int c = 0; c < channels; c++) {
+			const float* in = frames + (size_t)c * channelStride + skip;
+			float* out = &data[(size_t)pos * channels + c];
+			for (int i = 0; i < first; i++) {
+				out[(size_t)i * channels] = in[i];
+			}
+			out = &data[c];
+			for (int i = first; i < written; i++) {
+				out[(size_t)(i - first) * channels] = in[i];
+			}
+		}
+		if (commit) {
+			frameWrite.store(w + written, std::memory_order_release);
+		}
+		return written;
+	}
+
+	// producer: publishes count frames of the last uncommitted write, the next write overwrites them otherwise
+	void commitWrite(int count) {
+		frameWrite.store(frameWrite.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	// consumer: copies up to count interleaved frames to frames (room for count * getMaxChannels() floats),
+	// returns how many were read and sets channels to their channel count
+	int read(float* frames, int count, int& channels) {
+		while (true) {
+			uint64_t r = frameRead.load(std::memory_order_acquire);
+			int n = std::min(count, (int)(frameWrite.load(std::memory_order_acquire) - r));
+			if (n <= 0) {
+				return 0;
+			}
+			// after frameWrite, so frames written after a channel change are read with the new count
+			channels = this->channels.load(std::memory_order_acquire);
+			int pos = (int)(r % capacity);
+			int first = std::min(n, capacity - pos);
+			memcpy(frames, &data[(size_t)pos * channels], sizeof(float) * first * channels);
+			memcpy(frames + (size_t)first * channels, &data[0], sizeof(float) * (n - first) * channels);
+			// fails if the producer dropped the frames meanwhile
+			if (frameRead.compare_exchange_strong(r, r + n, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+				return n;
+			}
+		}
+	}
+
+	// consumer: drops up to count frames, returns how many
+	int skip(int count) {
+		while (true) {
+			uint64_t r = frameRead.load(std::memory_order_acquire);
+			int n = std::min(count, (int)(frameWrite.load(std::memory_order_acquire) - r));
+			if (n <= 0) {
+				return 0;
+			}
+			if (frameRead.compare_exchange_strong(r, r + n, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+				return n;
+			}
+		}
+	}
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "SharedMemory.h"
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+const uint32_t AUDIOMEMORY_MAGIC = 0x4F49444D; // "MDIO"
+const uint32_t AUDIOMEMORY_VERSION = 4;
+
+// control words written by different processes are kept on separate cache lines
+const size_t AUDIOMEMORY_CACHE_LINE = 64;
+// big slots start on their own page
+const size_t AUDIOMEMORY_PAGE = 4096;
+// readers that can register their position with the writer
+const int AUDIOMEMORY_READERS = 16;
+// limits of a stream description read from another process, beyond them it can't be a real stream
+const int AUDIOMEMORY_MAX_CHANNELS = 1024;
+const int AUDIOMEMORY_MAX_SAMPLE_RATE = 1536000;
+const int AUDIOMEMORY_MAX_FRAMES = 1 << 24; // bufferSize * memoryQueueSize
+
+// how the audio is placed in the shared memory, sent with the announcement
+enum class AudioLayout : int {
+	Slots = 0, // AudioData, memoryQueueSize blocks of bufferSize frames
+	Ring = 1, // AudioRing, bufferSize * memoryQueueSize frames written and read in any amount
+};
+
+// First bytes of every shared memory segment. The writer fills it before anything is published,
+// readers check it before they trust any offset. It describes the whole stream, so a receiver can attach
+// to a segment knowing only its name.
+struct AudioMemoryHeader {
+	uint32_t magic; // AUDIOMEMORY_MAGIC once the rest is valid
+	uint32_t version; // AUDIOMEMORY_VERSION
+	int32_t layout; // AudioLayout
+	int32_t format; // AudioSampleFormat of the samples
+	int32_t channels;
+	int32_t sampleRate;
+	int32_t bufferSize; // frames per slot
+	int32_t memoryQueueSize; // slots
+	uint64_t size; // bytes of the whole segment
+	uint64_t controlOffset; // first control cache line
+	uint64_t dataOffset; // first slot or first ring frame
+	uint64_t dataStride; // bytes from slot to slot, frames of the ring
+	int32_t port; // UDP port the sender receives data on
+	int32_t pid; // process of the writer, 0 - unknown
+	char name[52]; // sender name, zero terminated
+	uint32_t formatGeneration; // even, odd once the writer has moved on to a memory with another format
+
+	static AudioMemoryHeader* get(char* buf) {
+		return reinterpret_cast<AudioMemoryHeader*>(buf);
+	}
+
+	static size_t align(size_t value, size_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// the header takes whole cache lines, the control words follow
+	static size_t getControlOffset() {
+		return align(sizeof(AudioMemoryHeader), AUDIOMEMORY_CACHE_LINE);
+	}
+
+	void setName(const std::string& value) {
+		memset(name, 0, sizeof(name));
+		strncpy(name, value.c_str(), sizeof(name) - 1);
+	}
+
+	std::string getName() {
+		return std::string(name, strnlen(name, sizeof(name)));
+	}
+
+	uint32_t getFormatGeneration() {
+		return reinterpret_cast<std::atomic<uint32_t>*>(&formatGeneration)->load(std::memory_order_acquire);
+	}
+
+	// call after all the other fields are filled
+	void publish() {
+		version = AUDIOMEMORY_VERSION;
+		reinterpret_cast<std::atomic<uint32_t>*>(&magic)->store(AUDIOMEMORY_MAGIC, std::memory_order_release);
+	}
+
+	bool isValid() {
+		return reinterpret_cast<std::atomic<uint32_t>*>(&magic)->load(std::memory_order_acquire) == AUDIOMEMORY_MAGIC && version == AUDIOMEMORY_VERSION;
+	}
+
+	// false for a format no writer can have made, checked before a reader sizes anything by it
+	static bool isFormatValid(int layout, int format, int channels, int sampleRate, int bufferSize, int memoryQueueSize) {
+		return layout >= 0 && layout <= 1 && format >= 0 && format <= 3 &&
+			channels > 0 && channels <= AUDIOMEMORY_MAX_CHANNELS && sampleRate > 0 && sampleRate <= AUDIOMEMORY_MAX_SAMPLE_RATE &&
+			bufferSize > 0 && memoryQueueSize > 0 && bufferSize <= AUDIOMEMORY_MAX_FRAMES / memoryQueueSize;
+	}
+};
+
+static_assert(sizeof(AudioMemoryHeader) == 128, "AudioMemoryHeader is shared between processes, keep its size fixed");
+
+// Position of one reader, on a cache line of its own. Readers take a free entry when they attach,
+// so the writer knows how far behind each one is.
+struct AudioMemoryReader {
+	uint32_t state; // 0 - free, 1 - used
+	int32_t pid; // process of the reader, a dead one's entry is taken over
+	uint64_t position; // next block (frame in the ring layout) the reader reads
+	uint64_t heartbeat; // AudioMemoryReaders::getTime() of the last read or wait
+	uint64_t overruns; // blocks (frames) the reader lost
+	char reserved[32];
+};
+
+static_assert(sizeof(AudioMemoryReader) == AUDIOMEMORY_CACHE_LINE, "AudioMemoryReader is shared between processes, keep its size fixed");
+
+// The AUDIOMEMORY_READERS entries at some offset of a memory, used by the layouts
+class AudioMemoryReaders {
+public:
+	// a reader that hasn't read or waited for this long is ignored by the writer (paused or gone)
+	static const uint64_t TIMEOUT = 1000;
+
+	static size_t getSize() {
+		return sizeof(AudioMemoryReader) * AUDIOMEMORY_READERS;
+	}
+
+	// steady clock milliseconds, comparable between processes on one machine
+	static uint64_t getTime() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static AudioMemoryReader* get(char* buf, size_t offset, int idx) {
+		return reinterpret_cast<AudioMemoryReader*>(buf + offset) + idx;
+	}
+
+	// returns the entry of the reader or -1 when all are taken
+	static int attach(char* buf, size_t offset, uint64_t position) {
+		for (int i = 0; i < AUDIOMEMORY_READERS; i++) {
+			AudioMemoryReader* reader = get(buf, offset, i);
+			std::atomic<uint32_t>* state = reinterpret_cast<std::atomic<uint32_t>*>(&reader->state);
+			std::atomic<int32_t>* pid = reinterpret_cast<std::atomic<int32_t>*>(&reader->pid);
+			uint32_t value = 0;
+			if (!state->compare_exchange_strong(value, 1)) {
+				// take over the entry of a reader that crashed, pid 0 (just attaching) counts as alive
+				int32_t pidDead = pid->load();
+				if (SharedMemoryBase::isProcessAlive(pidDead) || !pid->compare_exchange_strong(pidDead, SharedMemoryBase::getProcessId())) {
+					continue;
+				}
+			}
+			pid->store(SharedMemoryBase::getProcessId());
+			reader->overruns = 0;
+			update(buf, offset, i, position, 0);
+			return i;
+		}
+		return -1;
+	}
+
+	static void detach(char* buf, size_t offset, int idx) {
+		if (idx >= 0) {
+			reinterpret_cast<std::atomic<int32_t>*>(&get(buf, offset, idx)->pid)->store(0);
+			reinterpret_cast<std::atomic<uint32_t>*>(&get(buf, offset, idx)->state)->store(0, std::memory_order_release);
+		}
+	}
+
+	static void update(char* buf, size_t offset, int idx, uint64_t position, uint64_t overruns) {
+		if (idx < 0) {
+			return;
+		}
+		AudioMemoryReader* reader = get(buf, offset, idx);
+		reinterpret_cast<std::atomic<uint64_t>*>(&reader->overruns)->store(overruns, std::memory_order_relaxed);
+		reinterpret_cast<std::atomic<uint64_t>*>(&reader->heartbeat)->store(getTime(), std::memory_order_relaxed);
+		reinterpret_cast<std::atomic<uint64_t>*>(&reader->position)->store(position, std::memory_order_release);
+	}
+
+	static void heartbeat(char* buf, size_t offset, int idx) {
+		if (idx >= 0) {
+			reinterpret_cast<std::atomic<uint64_t>*>(&get(buf, offset, idx)->heartbeat)->store(getTime(), std::memory_order_relaxed);
+		}
+	}
+
+	// how far the slowest active reader is behind written, 0 without readers; count gets the number of active readers
+	static uint64_t getSlowestLag(char* buf, size_t offset, uint64_t written, int* count = nullptr) {
+		uint64_t time = getTime();
+		uint64_t lag = 0;
+		int n = 0;
+		for (int i = 0; i < AUDIOMEMORY_READERS; i++) {
+			AudioMemoryReader* reader = get(buf, offset, i);
+			if (reinterpret_cast<std::atomic<uint32_t>*>(&reader->state)->load(std::memory_order_acquire) == 0 ||
+				time > reinterpret_cast<std::atomic<uint64_t>*>(&reader->heartbeat)->load(std::memory_order_relaxed) + TIMEOUT) {
+				continue;
+			}
+			uint64_t position = reinterpret_cast<std::atomic<uint64_t>*>(&reader->position)->load(std::memory_order_acquire);
+			lag = std::max(lag, written - std::min(position, written));
+			n++;
+		}
+		if (count != nullptr) {
+			*count = n;
+		}
+		return lag;
+	}
+};
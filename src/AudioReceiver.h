@@ -1,6 +1,9 @@
 #pragma once
 
 #include "AudioData.h"
+#include "AudioRing.h"
+#include "AudioRegistry.h"
+#include "AudioArena.h"
 #include "SharedMemory.h"
 
 #include "oscpp/server.hpp"
@@ -8,27 +11,68 @@
 #include "UDPsocket.h"
 
 #include "SpeexResampler.h"
+#include "AudioFrameQueue.h"
 
 #include <thread>
+#include <mutex>
 #include <chrono>
 #include <ctime>  
 
+const int AUDIORECEIVER_MAX_DRIFT_PPM = 2000; // biggest correction of the resampling ratio, 0.2%
+const int AUDIORECEIVER_MAX_CHANNELS = 32; // audioQueue has room for at least this many, so a format switch doesn't reallocate it
+// longest sleep of an idle reader thread, a futex can't be waited on together with the sender's pidfd,
+// so this is how long it takes to notice the sender has exited
+const int AUDIORECEIVER_LIVENESS_MICROS = 1000;
+
+// stream format of a connection, it changes when the sender calls AudioSender::updateFormat
+struct AudioReceiverFormat {
+	uint32_t generation; // formatGeneration of the memory being read
+	AudioLayout layout;
+	AudioSampleFormat sampleFormat;
+	int bufferSize;
+	int sampleRate;
+	int channels;
+	int memoryQueueSize;
+};
+
 // TODO: rename to receiver slot?
 struct AudioReceiverConnection {
 	chrono::time_point<chrono::system_clock> updateTime;
 
 	std::thread readerThread; // Memory sharing
-	bool isRunning;
+	bool isRunning = false;
 	bool shouldReadFromMemoryNow;
 
 	SharedMemoryReader sharedMemoryReader;
+	std::shared_ptr<SharedMemoryReader> arenaMemory; // when the stream is inside an arena
+	SharedMemoryOwner sharedMemoryOwner;
+	std::atomic<bool> isOwnerAlive{ true }; // written by the reader thread, read by AudioReceiver
+	uint32_t formatGeneration = 0; // of the memory being read
+	std::atomic<bool> isFormatChanging{ false }; // the sender has moved on to a memory with another format
+	std::mutex mutexFormat; // held while the reader thread switches the memory or changes the format fields
+	std::atomic<int> tornReads{ 0 }; // published by the reader thread, see getTornReads
+	std::atomic<int> overruns{ 0 };
 	AudioData audioData;
 	AudioDataReader audioDataReader;
+	AudioRing audioRing;
+	AudioRingReader audioRingReader;
+	vector<float> ringReadData;
+	int ringReadFrames;
 
 	speexport::SpeexResampler speexResampler;
 
 	vector<float> resampledReceivedAudioData;
+	vector<float> receivedCopy; // a zero-copy block for the resampler, once it is known to be whole
 	int resampledBufferSize;
+	bool isResamplerBypassed = false; // the rates match, blocks are copied as they are
+	std::atomic<int> droppedFrames{ 0 }; // written by the reader thread, see getDroppedFrames
+
+	// drift compensation, see driftCompensation
+	double driftFillSum = 0;
+	int driftFillCount = 0;
+	int driftFrames = 0;
+	double driftIntegral = 0;
+	std::atomic<int> driftPpm{ 0 }; // read by getDriftCorrection from other threads
 
 	std::thread settingsReceiverSocketThread; // OSC
     
@@ -41,17 +85,43 @@ public:
 	// data
 	string nameSharedMemory;
 	string name;
+	// The format fields are set before init. Afterwards the reader thread changes them on a format switch,
+	// other threads take a consistent copy with getFormat (the audio callback gets the channels from audioQueue.read).
 	int bufferSize;
 	int sampleRate;
 	int channels;
 	int memoryQueueSize;
+	AudioLayout layout = AudioLayout::Slots;
+	AudioSampleFormat sampleFormat = AudioSampleFormat::Float32; // in the memory, converted to float when read
 	int portReceive = -1;
 	int portSend = -1;
+	uint64_t registryGeneration = 0; // of the registry entry the connection was made from
 
 	int requiredBufferSizeForQueue;
 	int requiredSampleRate;
 
-	moodycamel::ReaderWriterQueue<float> audioQueue;
+	// resample directly from the shared memory instead of copying the slot first
+	bool zeroCopyRead = true;
+	// how many times the reader thread polls before it goes to sleep until the next block, for the lowest latency
+	int spinBeforeWait = 0;
+	// map the ring layout twice so it never wraps (Linux)
+	bool mirrorRing = true;
+	// back the mapping with transparent huge pages if possible (Linux)
+	bool hugePages = false;
+	// keep the mapping in RAM for real-time use, see isMemoryLocked
+	bool lockMemory = false;
+
+	// what happens to resampled frames the audio callback doesn't keep up with, Signal makes the reader thread wait for room
+	AudioQueueOverflow queueOverflow = AudioQueueOverflow::DropNewest;
+	// adjust the resampling ratio to hold audioQueue at driftTargetFrames, so the clock drift between
+	// sender and receiver doesn't end in dropped frames or underruns
+	bool driftCompensation = false;
+	// fill of audioQueue after the reader thread wrote to it, 0 - half its capacity; at most the capacity
+	// less one receiver block
+	int driftTargetFrames = 0;
+	// resampled interleaved frames for the audio callback, read them with audioQueue.read,
+	// which also tells their channel count (it changes with the format of the stream)
+	AudioFrameQueue audioQueue;
 	bool isBufferReadyForReading;
 
 
@@ -65,35 +135,26 @@ public:
 
 	void init() {
 		close();
+		// the format comes from another process, a zero would divide by zero in setupFormat
+		if (!AudioMemoryHeader::isFormatValid((int)layout, (int)sampleFormat, channels, sampleRate, bufferSize, memoryQueueSize)) {
+			cout << std::string("Memory sharing describes an invalid format!") << endl;
+			isOwnerAlive = false;
+			return;
+		}
 
 		socket.open();
-		for (int i = PORT_MEMORYSHARING + 1; i < PORT_MEMORYSHARING + 1000; i++) {
-			if (socket.bind(i) == (int)UDPsocket::Status::OK) {
-				portReceive = i;
-				break;
-			}
-		}
+		uint16_t port = 0;
+		portReceive = socket.bind_any(port) == (int)UDPsocket::Status::OK ? port : -1;
 		if (socket.send("port:" + std::to_string(portReceive), UDPsocket::IPv4::Loopback(portSend)) == (int)UDPsocket::Status::SendError) {
 			std::cout << "socket send error" << std::endl;
 		}
 
-		int err = 0;
-		speexResampler.init(channels, sampleRate, requiredSampleRate, 4, &err);
-
-		resampledBufferSize = (1.0 * bufferSize * requiredSampleRate / sampleRate);
-		resampledReceivedAudioData.resize(resampledBufferSize * channels);
-
-		audioData.init(bufferSize * channels, memoryQueueSize);
-#ifdef TARGET_WIN32
-		sharedMemoryReader.init(nameSharedMemory, 0, audioData.getSize());
-#else 
-		sharedMemoryReader.init("", std::stoi(nameSharedMemory), audioData.getSize());
-#endif
-
-        if(!sharedMemoryReader.isOpened()) {
-            cout << std::string("Error while open memory sharing to read!") << endl;
-//            throw std::exception();
-        }
+		setupFormat(false);
+		// allocated once, a format switch only changes its channels while the audio callback goes on reading
+		audioQueue.init(std::max(channels, AUDIORECEIVER_MAX_CHANNELS), getQueueFrames(), queueOverflow);
+		audioQueue.setChannels(channels);
+		openStream();
+		isOwnerAlive = true;
         
         
 		isRunning = true;
@@ -115,44 +176,102 @@ public:
 
 		readerThread = std::thread([&]() {
 			while (isRunning) {
-				if (shouldReadFromMemoryNow && audioDataReader.readFromMemory(sharedMemoryReader, audioData)) {
-					
-					// resampling
-					for (int c = 0; c < channels; c++) {
-						unsigned int in_len = bufferSize;
-						unsigned int out_len = resampledBufferSize;
-						speexResampler.process(c, &audioData.data[audioDataReader.idxRead][c * bufferSize], &in_len, &resampledReceivedAudioData[c * resampledBufferSize], &out_len);
+				const float* receivedData = nullptr;
+				int receivedFrames = 0;
+				// compact sample formats have to be converted first
+				bool isZeroCopy = zeroCopyRead && (layout == AudioLayout::Slots || sampleFormat == AudioSampleFormat::Float32);
+				if (shouldReadFromMemoryNow && isOwnerAlive) {
+					if (layout == AudioLayout::Ring && isZeroCopy) {
+						receivedFrames = ringReadFrames;
+						receivedData = audioRingReader.beginRead(sharedMemoryReader, audioRing, receivedFrames);
 					}
- 
-					int size = audioQueue.size_approx();
-					if (size > 2 * requiredBufferSizeForQueue * channels && size > 2 * audioData.DATABUFFER_SIZE * audioData.DATABUFFERS_COUNT) {
-						audioQueue = moodycamel::ReaderWriterQueue<float>();
-						std::cout << "recreate audio queue (size " << size << ")" << std::endl;
+					else if (layout == AudioLayout::Ring) {
+						receivedFrames = audioRingReader.read(sharedMemoryReader, audioRing, ringReadData.data(), ringReadFrames);
+						if (receivedFrames > 0) {
+							receivedData = ringReadData.data();
+						}
+					}
+					else if (isZeroCopy) {
+						receivedData = audioDataReader.beginRead(sharedMemoryReader, audioData);
+						receivedFrames = bufferSize;
+					}
+					else if (audioDataReader.readFromMemory(sharedMemoryReader, audioData)) {
+						receivedData = audioData.data[audioDataReader.idxRead].data();
+						receivedFrames = bufferSize;
 					}
+					updateCounters();
+				}
 
-					/*
-					for (int i = 0; i < bufferSize; i++) {
-						for (int c = 0; c < channels; c++) {
-							if (!audioQueue.enqueue(audioData.data[audioDataReader.idxRead][c * bufferSize + i])) {
-								cout << "error" << endl;
+				if (receivedData != nullptr) {
+					int resampledFrames = 0;
+					int writtenFrames = 0;
+					if (isResamplerBypassed) {
+						// the rates match, so the frames go straight into the queue, published once the read is known to be whole
+						resampledFrames = receivedFrames;
+						waitForQueue(resampledFrames);
+						if (layout == AudioLayout::Ring) {
+							writtenFrames = audioQueue.write(receivedData, receivedFrames, !isZeroCopy);
+						}
+						else {
+							writtenFrames = audioQueue.writePlanar(receivedData, bufferSize, receivedFrames, !isZeroCopy);
+						}
+					}
+					else {
+						// the resampler keeps a history, a torn block must not get into it: copy it out and check it first
+						if (isZeroCopy) {
+							memcpy(receivedCopy.data(), receivedData, sizeof(float) * receivedFrames * channels);
+							if (!endZeroCopyRead(receivedFrames)) {
+								continue;
 							}
+							receivedData = receivedCopy.data();
+						}
+						// resampling
+						for (int c = 0; c < channels; c++) {
+							unsigned int in_len = receivedFrames;
+							unsigned int out_len = resampledBufferSize;
+							const float* in = layout == AudioLayout::Ring ? &receivedData[c] : &receivedData[c * bufferSize];
+							speexResampler.process(c, in, &in_len, &resampledReceivedAudioData[c * resampledBufferSize], &out_len);
+							resampledFrames = out_len;
 						}
 					}
-					*/
-
-					//audioData.data[audioDataReader.idxRead][i + c * resampledBufferSize]
 
-					for (int i = 0; i < resampledBufferSize; i++) {
-						for (int c = 0; c < channels; c++) {
-							while (!audioQueue.enqueue(resampledReceivedAudioData[i + c * resampledBufferSize])) {
-								std::cout << "error" << std::endl;
-							}
+					// drop the block if the sender was writing into it meanwhile
+					if (isZeroCopy && isResamplerBypassed) {
+						if (!endZeroCopyRead(receivedFrames)) {
+							continue;
 						}
+						audioQueue.commitWrite(writtenFrames);
+					}
+ 
+					if (!isResamplerBypassed) {
+						// interleaved on the copy, frames that don't fit are handled by queueOverflow
+						waitForQueue(resampledFrames);
+						writtenFrames = audioQueue.writePlanar(resampledReceivedAudioData.data(), resampledBufferSize, resampledFrames);
+					}
+					if (audioQueue.getOverflow() == AudioQueueOverflow::Signal) {
+						droppedFrames += resampledFrames - writtenFrames;
+					}
+					if (driftCompensation) {
+						compensateDrift(resampledFrames);
 					}
-					
+
 					//std::this_thread::sleep_for(std::chrono::milliseconds(1));
 					isBufferReadyForReading = true;
 				}
+				else if (shouldReadFromMemoryNow && isOwnerAlive) {
+					if (layout == AudioLayout::Ring) {
+						audioRingReader.waitForData(sharedMemoryReader, audioRing, AUDIORECEIVER_LIVENESS_MICROS, spinBeforeWait);
+					}
+					else {
+						audioDataReader.waitForData(sharedMemoryReader, audioData, AUDIORECEIVER_LIVENESS_MICROS, spinBeforeWait);
+					}
+					// nothing new, the sender may have crashed, left its arena or moved on to another format
+					isOwnerAlive = sharedMemoryOwner.isAlive() && (!sharedMemoryReader.isOpened() || AudioMemoryHeader::get(sharedMemoryReader.getBuffer())->isValid());
+					if (isFormatChanging || (sharedMemoryReader.isOpened() && AudioMemoryHeader::get(sharedMemoryReader.getBuffer())->getFormatGeneration() != formatGeneration)) {
+						// the old memory is read up, retry until the new one is published
+						isFormatChanging = !switchFormat();
+					}
+				}
                 else {
                     std::this_thread::sleep_for(std::chrono::milliseconds(5));
                 }
@@ -161,30 +280,303 @@ public:
 		readerThread.detach();
 	}
 
+	// Takes the stream description from the header of the shared memory and calls init,
+	// so only nameSharedMemory has to be set. Returns false if there is no compatible stream.
+	bool initFromMemory() {
+		SharedMemoryReader headerReader;
+		if (!openMemory(headerReader, sizeof(AudioMemoryHeader))) {
+			return false;
+		}
+		AudioMemoryHeader* header = AudioMemoryHeader::get(headerReader.getBuffer());
+		if (!header->isValid()) {
+			cout << std::string("Memory sharing has an unknown version!") << endl;
+			return false;
+		}
+
+		name = header->getName();
+		layout = (AudioLayout)header->layout;
+		sampleFormat = (AudioSampleFormat)header->format;
+		bufferSize = header->bufferSize;
+		sampleRate = header->sampleRate;
+		channels = header->channels;
+		memoryQueueSize = header->memoryQueueSize;
+		portSend = header->port;
+		headerReader.close();
+
+		init();
+		return sharedMemoryReader.isOpened();
+	}
+
 	void sendData(std::string str) {
 		if (portSend < 0 || socket.send(str, UDPsocket::IPv4::Loopback(portSend)) == (int)UDPsocket::Status::SendError) {
 			std::cout << "socket send error" << std::endl;
 		}
 	}
 
+	// false without lockMemory or if locking failed, usually RLIMIT_MEMLOCK (ulimit -l) is too low then
+	bool isMemoryLocked() {
+		return sharedMemoryReader.isLocked();
+	}
+
+	// true while the sender recreates the memory with another format, its name may be gone meanwhile
+	bool isChangingFormat() {
+		std::lock_guard<std::mutex> lock(mutexFormat);
+		return isFormatChanging || (sharedMemoryReader.isOpened() && AudioMemoryHeader::get(sharedMemoryReader.getBuffer())->getFormatGeneration() != formatGeneration);
+	}
+
+	// false once the sender process has exited, AudioReceiver drops the connection then
+	bool isSenderAlive() {
+		return isOwnerAlive;
+	}
+
 	void setActive(bool status) {
 		shouldReadFromMemoryNow = status;
 	}
 
+	// copy of the current format fields, see AudioReceiverFormat
+	AudioReceiverFormat getFormat() {
+		std::lock_guard<std::mutex> lock(mutexFormat);
+		return { formatGeneration, layout, sampleFormat, bufferSize, sampleRate, channels, memoryQueueSize };
+	}
+
+	// number of blocks (reads in ring layout) the sender overwrote while they were being read
+	int getTornReads() {
+		return tornReads.load(std::memory_order_relaxed);
+	}
+
+	// resampled frames lost because audioQueue was full, the audio callback doesn't keep up
+	int getDroppedFrames() {
+		return droppedFrames + (int)audioQueue.getDroppedFrames();
+	}
+
+	// current correction of the resampling ratio in ppm, positive when the receiver clock is slower than the sender's
+	int getDriftCorrection() {
+		return driftPpm;
+	}
+
+	// number of blocks (frames in ring layout) lost because the sender got more than memoryQueueSize blocks ahead
+	int getOverruns() {
+		return overruns.load(std::memory_order_relaxed);
+	}
+
 	void close() {
 		if (isRunning) {
 			isRunning = false;
 			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			audioDataReader.detach(sharedMemoryReader, audioData);
+			audioRingReader.detach(sharedMemoryReader, audioRing);
 			sharedMemoryReader.close();
+			arenaMemory.reset();
+			sharedMemoryOwner.close();
 			socket.close();
 		}
 	}
+
+private:
+	// prepares the resampler and the layout for the current format,
+	// keepResampler - only the sample rate changed, the resampler goes on with its state
+	void setupFormat(bool keepResampler) {
+		int err = 0;
+		if (keepResampler) {
+			speexResampler.set_rate(sampleRate, requiredSampleRate);
+		}
+		else {
+			speexResampler.init(channels, sampleRate, requiredSampleRate, 4, &err);
+		}
+		// the ring is interleaved
+		speexResampler.set_input_stride(layout == AudioLayout::Ring ? channels : 1);
+		driftFillSum = 0;
+		driftFillCount = 0;
+		driftFrames = 0;
+		driftIntegral = 0;
+		driftPpm = 0;
+
+		// one extra frame, the resampler may produce it on some blocks, and room for the drift correction
+		double maxRatio = driftCompensation ? 1.0 + AUDIORECEIVER_MAX_DRIFT_PPM * 1e-6 : 1.0;
+		resampledBufferSize = (int)ceil(maxRatio * bufferSize * requiredSampleRate / sampleRate) + 1;
+		// the drift compensation needs the resampler even then
+		isResamplerBypassed = sampleRate == requiredSampleRate && !driftCompensation;
+		resampledReceivedAudioData.resize(isResamplerBypassed ? 0 : resampledBufferSize * channels);
+		receivedCopy.resize(isResamplerBypassed || !zeroCopyRead ? 0 : bufferSize * channels);
+
+		audioData.init(bufferSize * channels, memoryQueueSize, layout == AudioLayout::Slots && !zeroCopyRead);
+		audioRing.init(channels, bufferSize * memoryQueueSize, sampleFormat);
+		audioRingReader = AudioRingReader();
+		audioDataReader = AudioDataReader();
+
+		// read the ring in chunks no bigger than the receiver block, this is what keeps the latency low
+		ringReadFrames = std::max(1, std::min(bufferSize, (int)(1.0 * requiredBufferSizeForQueue * sampleRate / requiredSampleRate)));
+		// compact formats are converted into it
+		ringReadData.resize(layout == AudioLayout::Ring && (!zeroCopyRead || sampleFormat != AudioSampleFormat::Float32) ? ringReadFrames * channels : 0);
+	}
+
+	// frames audioQueue needs for the current format, about two sender queues or receiver blocks
+	int getQueueFrames() {
+		return std::max(2 * requiredBufferSizeForQueue, 2 * bufferSize * memoryQueueSize) + resampledBufferSize;
+	}
+
+	// reader thread: false if the sender wrote into the block from beginRead meanwhile, it has to be dropped
+	bool endZeroCopyRead(int receivedFrames) {
+		if (layout == AudioLayout::Ring) {
+			return audioRingReader.endRead(sharedMemoryReader, audioRing, receivedFrames);
+		}
+		return audioDataReader.endRead(sharedMemoryReader, audioData);
+	}
+
+	// reader thread: publishes the counters of the reader for getTornReads and getOverruns
+	void updateCounters() {
+		tornReads.store(layout == AudioLayout::Ring ? audioRingReader.tornReads : audioDataReader.tornReads, std::memory_order_relaxed);
+		overruns.store(layout == AudioLayout::Ring ? audioRingReader.overrunFrames : audioDataReader.overruns, std::memory_order_relaxed);
+	}
+
+	// AudioQueueOverflow::Signal: waits until frames fit into audioQueue,
+	// the shared memory backs up meanwhile, the sender or getOverruns tells about it
+	void waitForQueue(int frames) {
+		if (audioQueue.getOverflow() != AudioQueueOverflow::Signal || frames > audioQueue.getCapacity()) {
+			return;
+		}
+		while (audioQueue.getCapacity() - audioQueue.getAvailableFrames() < frames && isRunning && shouldReadFromMemoryNow) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	// PI loop on the average fill of audioQueue. The ratio is changed about twice a second at most, as
+	// SpeexResampler rebuilds its filter table on every change.
+	void compensateDrift(int frames) {
+		driftFillSum += audioQueue.getAvailableFrames();
+		driftFillCount++;
+		driftFrames += frames;
+		if (driftFrames < requiredSampleRate / 2) {
+			return;
+		}
+
+		// half the queue by default; at most what leaves room for a receiver block, or the fill can't get there
+		int maxTargetFrames = std::max(1, audioQueue.getCapacity() - requiredBufferSizeForQueue);
+		int targetFrames = std::min(driftTargetFrames > 0 ? driftTargetFrames : audioQueue.getCapacity() / 2, maxTargetFrames);
+		double error = (driftFillSum / driftFillCount - targetFrames) / requiredSampleRate; // seconds too much queued
+		double interval = 1.0 * driftFrames / requiredSampleRate;
+		driftFillSum = 0;
+		driftFillCount = 0;
+		driftFrames = 0;
+
+		// the error goes away in about 20 s, slow enough to average out the scheduling jitter and keep the
+		// pitch change inaudible, the integral settles on the drift itself
+		double maxCorrection = AUDIORECEIVER_MAX_DRIFT_PPM * 1e-6;
+		double proportional = error / 20.0;
+		driftIntegral = std::min(std::max(driftIntegral + proportional * interval / 40.0, -maxCorrection), maxCorrection);
+		int ppm = (int)round(std::min(std::max(proportional + driftIntegral, -maxCorrection), maxCorrection) * 1e6);
+		if (ppm == driftPpm) {
+			return;
+		}
+		driftPpm = ppm;
+
+		// more input per output frame while too much is queued, the denominator stays small enough for
+		// the resampler's 32 bit phase arithmetic
+		uint32_t scale = 100000000u / std::max(sampleRate, requiredSampleRate);
+		uint32_t ratioNum = (uint32_t)llround(1.0 * sampleRate * scale * (1.0 + ppm * 1e-6));
+		speexResampler.set_rate_frac(ratioNum, (uint32_t)requiredSampleRate * scale, sampleRate, requiredSampleRate);
+	}
+
+	// maps the memory laid out by setupFormat, false if it isn't there or has another format
+	bool openStream() {
+		size_t size = layout == AudioLayout::Ring ? audioRing.getSize() : audioData.getSize();
+		sharedMemoryReader.setMirroredRange(layout == AudioLayout::Ring && mirrorRing ? audioRing.getDataOffset() : -1);
+		sharedMemoryReader.setHugePages(hugePages);
+		sharedMemoryReader.setLocked(lockMemory);
+		openMemory(sharedMemoryReader, size);
+
+        if(!sharedMemoryReader.isOpened()) {
+            cout << std::string("Error while open memory sharing to read!") << endl;
+//            throw std::exception();
+			return false;
+        }
+		if (!(layout == AudioLayout::Ring ? audioRing.checkHeader(sharedMemoryReader.getBuffer()) : audioData.checkHeader(sharedMemoryReader.getBuffer()))) {
+			cout << std::string("Memory sharing has an unknown version or layout!") << endl;
+			sharedMemoryReader.close();
+			return false;
+		}
+		formatGeneration = AudioMemoryHeader::get(sharedMemoryReader.getBuffer())->getFormatGeneration();
+		sharedMemoryOwner.init(AudioMemoryHeader::get(sharedMemoryReader.getBuffer())->pid);
+		return true;
+	}
+
+	// The sender moved the stream to a new memory with another format (AudioSender::updateFormat), called by
+	// the reader thread once the old memory is read up. Keeps the threads, and the resampler if the channels stay.
+	// False while the new memory isn't published yet.
+	bool switchFormat() {
+		SharedMemoryReader headerReader;
+		if (!headerReader.open(nameSharedMemory, sizeof(AudioMemoryHeader))) {
+			return false;
+		}
+		AudioMemoryHeader* header = AudioMemoryHeader::get(headerReader.getBuffer());
+		uint32_t generation = header->getFormatGeneration();
+		if (!header->isValid() || generation == formatGeneration || (generation & 1)) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(mutexFormat);
+		updateCounters();
+		audioDataReader.detach(sharedMemoryReader, audioData);
+		audioRingReader.detach(sharedMemoryReader, audioRing);
+		sharedMemoryReader.close();
+		sharedMemoryOwner.close();
+
+		if (!AudioMemoryHeader::isFormatValid(header->layout, header->format, header->channels, header->sampleRate, header->bufferSize, header->memoryQueueSize)) {
+			cout << std::string("Memory sharing describes an invalid format!") << endl;
+			isOwnerAlive = false;
+			return true;
+		}
+		bool keepResampler = header->channels == channels;
+		layout = (AudioLayout)header->layout;
+		sampleFormat = (AudioSampleFormat)header->format;
+		bufferSize = header->bufferSize;
+		sampleRate = header->sampleRate;
+		channels = header->channels;
+		memoryQueueSize = header->memoryQueueSize;
+		headerReader.close();
+
+		setupFormat(keepResampler);
+		if (getQueueFrames() > audioQueue.getCapacity() || !audioQueue.setChannels(channels)) {
+			// AudioReceiver drops the connection and makes a new one with a bigger queue
+			cout << std::string("The stream has more channels or bigger blocks than the audio queue was made for!") << endl;
+			isOwnerAlive = false;
+			return true;
+		}
+		// the counters go on from where the old memory left them
+		if (layout == AudioLayout::Ring) {
+			audioRingReader.tornReads = tornReads;
+			audioRingReader.overrunFrames = overruns;
+		}
+		else {
+			audioDataReader.tornReads = tornReads;
+			audioDataReader.overruns = overruns;
+		}
+		return openStream();
+	}
+
+	bool openMemory(SharedMemoryReader& reader, size_t size) {
+		std::string nameArena;
+		size_t offset;
+		if (AudioArena::parseStreamName(nameSharedMemory, nameArena, offset)) {
+			// all streams of an arena share one mapping
+			arenaMemory = AudioArena::open(nameArena, hugePages, lockMemory);
+			if (!arenaMemory || offset + size > (size_t)arenaMemory->getSize()) {
+				return false;
+			}
+			reader.initView(*arenaMemory, offset, (int)size);
+			return true;
+		}
+		return reader.open(nameSharedMemory, size);
+	}
 };
 
 class AudioReceiver {
 	UDPsocket socket;
+	AudioRegistry registry;
+	SharedMemoryWatcher watcher;
+	std::map<string, uint64_t> pendingSegments; // created memory waiting for its header, with the time it appeared
 
-    bool isRunning;
+    bool isRunning = false;
     
 	std::mutex mutexForSocket;
 	std::map<string, AudioReceiverConnection*> audioSenderConnections;
@@ -193,6 +585,16 @@ public:
 
 	int requiredBufferSizeForQueue = 512;
 	int requiredSampleRate = 44100;
+	bool zeroCopyRead = true;
+	int spinBeforeWait = 0;
+	bool mirrorRing = true;
+	bool hugePages = false;
+	bool lockMemory = false;
+	AudioQueueOverflow queueOverflow = AudioQueueOverflow::DropNewest;
+	bool driftCompensation = false;
+	int driftTargetFrames = 0;
+	bool useBroadcast = true; // also listen for the UDP announcements of senders without the registry (older versions)
+	bool watchSharedMemory = false; // Linux: attach to new senders and drop closed ones within milliseconds (inotify)
 	std::function<void(AudioReceiverConnection*, std::string)> dataReceivedCallback;
 
 	~AudioReceiver() {
@@ -201,71 +603,47 @@ public:
 
 	void init() {
 		close();
+		registry.init();
+		if (watchSharedMemory) {
+			watcher.init();
+		}
+		isRunning = true;
+
 		std::thread threadSocket([&]() {
-			socket.open();
-            if(socket.bind(PORT_MEMORYSHARING) == (int)UDPsocket::Status::OK) {
-                UDPsocket::IPv4 ipaddr;
-                std::string data;
-                while (isRunning) {
-                    data = "";
-                    size_t dataSize = socket.recv(data, ipaddr);
-                    if (!data.empty() && data != "") {
-						OSCPP::Server::Message msg(OSCPP::Server::Packet(data.c_str(), dataSize));
-                        OSCPP::Server::ArgStream args(msg.args());
-                        if (msg == "/memorySharing") {
-                            const char* nameSharedMemory = args.string();
-                            
-							mutexForSocket.lock();
-							if (audioSenderConnections.find(nameSharedMemory) != audioSenderConnections.end()) {
-                                audioSenderConnections[nameSharedMemory]->updateTime = std::chrono::system_clock::now();
-                                
-                                string name = args.string();
-                                int bufferSize = args.int32();
-                                int sampleRate = args.int32();
-                                int channels = args.int32();
-                                int memoryQueueSize = args.int32();
-                                int portSend = args.int32();
-
-                                if(audioSenderConnections[nameSharedMemory]->portSend !=  portSend) {
-                                    audioSenderConnections[nameSharedMemory]->close();
-                                    audioSenderConnections.erase(audioSenderConnections.find(nameSharedMemory));
-                                }
-                              
-                            }
-                            else {
-                                AudioReceiverConnection* audioClientConnection = new AudioReceiverConnection();
-                                audioClientConnection->updateTime = std::chrono::system_clock::now();
-                                
-                                audioClientConnection->nameSharedMemory = nameSharedMemory;
-								audioClientConnection->name = args.string();
-								audioClientConnection->bufferSize = args.int32();
-								audioClientConnection->sampleRate = args.int32();
-								audioClientConnection->channels = args.int32();
-								audioClientConnection->memoryQueueSize = args.int32();
-								audioClientConnection->portSend = args.int32();
-
-								audioClientConnection->requiredBufferSizeForQueue = requiredBufferSizeForQueue;
-								audioClientConnection->requiredSampleRate = requiredSampleRate;
-								audioClientConnection->settingsReceivedCallback = dataReceivedCallback;
-
-                                audioClientConnection->init();
-                                
-                                audioSenderConnections[nameSharedMemory] = audioClientConnection;
-                                
-                                cout << "created nameSharedMemory: " << nameSharedMemory << endl;
-                            }
-							mutexForSocket.unlock();
-						}
-                    }
-                }
-				cout << "closed socket" << endl;
-            }
-			
+			bool isBound = false;
+			if (useBroadcast) {
+				socket.open();
+				isBound = socket.bind(PORT_MEMORYSHARING) == (int)UDPsocket::Status::OK;
+			}
+
+			UDPsocket::IPv4 ipaddr;
+			std::string data;
+			while (isRunning) {
+				uint32_t generation = registry.getGeneration();
+				syncWithRegistry();
+				removeDeadConnections();
+
+				bool isSocketReady = isBound;
+				if (watcher.isOpened()) {
+					// poll quickly while new memory waits for its header, the socket is polled along so neither waits for the other
+					handleSegmentEvents(watcher.wait(pendingSegments.empty() ? 100 : 1, isBound ? socket.get_handle() : -1, &isSocketReady));
+				}
+
+				// recv returns after 100 ms at most, so the registry is still checked regularly
+				if (isSocketReady) {
+					data = "";
+					size_t dataSize = socket.recv(data, ipaddr);
+					if (!data.empty()) {
+						receiveAnnouncement(data, dataSize);
+					}
+				}
+				else if (!isBound && !watcher.isOpened()) {
+					registry.waitForChange(generation, 100000);
+				}
+			}
+			cout << "closed socket" << endl;
 		});
-        
-        isRunning = true;
 		threadSocket.detach();
-
 	}
 
 	void update() {
@@ -277,7 +655,7 @@ public:
 		{
 			++next_it;
 			std::chrono::duration<double> diff = time - it->second->updateTime;
-            if (diff.count() > 1.0)
+            if (diff.count() > 1.0 || !it->second->isSenderAlive())
             {
 				it->second->close();
 				audioSenderConnections.erase(it);
@@ -286,6 +664,28 @@ public:
         mutexForSocket.unlock();
 	}
 
+	// Attaches to a sender by the name of its shared memory right away, the stream description is read
+	// from the memory instead of waiting for the announcement. Returns nullptr if there is no such stream.
+	AudioReceiverConnection* connect(std::string nameSharedMemory) {
+		std::lock_guard<std::mutex> lock(mutexForSocket);
+		if (audioSenderConnections.find(nameSharedMemory) != audioSenderConnections.end()) {
+			return audioSenderConnections[nameSharedMemory];
+		}
+
+		AudioReceiverConnection* audioClientConnection = new AudioReceiverConnection();
+		audioClientConnection->updateTime = std::chrono::system_clock::now();
+		audioClientConnection->nameSharedMemory = nameSharedMemory;
+		setupConnection(audioClientConnection);
+		if (!audioClientConnection->initFromMemory()) {
+			delete audioClientConnection;
+			return nullptr;
+		}
+
+		audioSenderConnections[nameSharedMemory] = audioClientConnection;
+		cout << "created nameSharedMemory: " << nameSharedMemory << endl;
+		return audioClientConnection;
+	}
+
 	std::map<string, AudioReceiverConnection*> getAudioClientConnections() {
 		return audioSenderConnections;
 	}
@@ -310,7 +710,200 @@ public:
 			mutexForSocket.lock();
 			socket.close();
 			mutexForSocket.unlock();
+
+			watcher.close();
+			pendingSegments.clear();
 		}
 	}
-};
+private:
+	// creates connections for new streams in the registry, keeps alive the ones whose sender still updates
+	void syncWithRegistry() {
+		std::vector<AudioRegistryEntry> entries = registry.list();
+		if (entries.empty()) {
+			return;
+		}
+		uint64_t time = AudioRegistry::getTime();
+
+		std::lock_guard<std::mutex> lock(mutexForSocket);
+		for (auto& entry : entries) {
+			// the sender stopped calling update, AudioReceiver::update removes it
+			if (time > entry.heartbeat + 1000) {
+				continue;
+			}
+
+			if (!AudioMemoryHeader::isFormatValid(entry.layout, entry.format, entry.channels, entry.sampleRate, entry.bufferSize, entry.memoryQueueSize)) {
+				continue;
+			}
+			std::string nameSharedMemory = entry.getNameSharedMemory();
+			auto it = audioSenderConnections.find(nameSharedMemory);
+			if (it == audioSenderConnections.end() && !SharedMemoryBase::isProcessAlive(entry.pid)) {
+				continue;
+			}
+			if (it != audioSenderConnections.end()) {
+				if (it->second->registryGeneration == entry.generation || it->second->registryGeneration == 0) {
+					it->second->registryGeneration = entry.generation;
+					it->second->updateTime = std::chrono::system_clock::now();
+					continue;
+				}
+				// the memory was reused by another sender
+				it->second->close();
+				audioSenderConnections.erase(it);
+			}
 
+			AudioReceiverConnection* audioClientConnection = new AudioReceiverConnection();
+			audioClientConnection->updateTime = std::chrono::system_clock::now();
+			audioClientConnection->nameSharedMemory = nameSharedMemory;
+			audioClientConnection->name = entry.getName();
+			audioClientConnection->bufferSize = entry.bufferSize;
+			audioClientConnection->sampleRate = entry.sampleRate;
+			audioClientConnection->channels = entry.channels;
+			audioClientConnection->memoryQueueSize = entry.memoryQueueSize;
+			audioClientConnection->portSend = entry.port;
+			audioClientConnection->layout = (AudioLayout)entry.layout;
+			audioClientConnection->sampleFormat = (AudioSampleFormat)entry.format;
+			audioClientConnection->registryGeneration = entry.generation;
+
+			setupConnection(audioClientConnection);
+			audioClientConnection->init();
+
+			audioSenderConnections[nameSharedMemory] = audioClientConnection;
+
+			cout << "created nameSharedMemory: " << nameSharedMemory << endl;
+		}
+	}
+
+	// drops the connections whose sender process has exited without closing
+	void removeDeadConnections() {
+		std::lock_guard<std::mutex> lock(mutexForSocket);
+		for (auto it = audioSenderConnections.begin(); it != audioSenderConnections.end();) {
+			if (it->second->isSenderAlive()) {
+				++it;
+				continue;
+			}
+			AudioReceiverConnection* audioClientConnection = it->second;
+			cout << "sender exited nameSharedMemory: " << it->first << endl;
+			it = audioSenderConnections.erase(it);
+			audioClientConnection->close();
+		}
+	}
+
+	void handleSegmentEvents(const std::vector<SharedMemoryWatcher::Event>& events) {
+		for (auto& event : events) {
+			if (event.created) {
+				pendingSegments[event.name] = AudioRegistry::getTime();
+				continue;
+			}
+			pendingSegments.erase(event.name);
+
+			std::lock_guard<std::mutex> lock(mutexForSocket);
+			auto it = audioSenderConnections.find(getNameSharedMemory(event.name));
+			// a sender changing its format recreates the memory under the same name
+			AudioMemoryHeader header;
+			if (it != audioSenderConnections.end() && !it->second->isChangingFormat() &&
+				!(SharedMemoryWatcher::peek(event.name, &header, sizeof(header)) && header.isValid())) {
+				AudioReceiverConnection* audioClientConnection = it->second;
+				audioSenderConnections.erase(it);
+				audioClientConnection->close();
+				cout << "removed nameSharedMemory: " << getNameSharedMemory(event.name) << endl;
+			}
+		}
+
+		// attach as soon as the sender has published the header
+		uint64_t time = AudioRegistry::getTime();
+		for (auto it = pendingSegments.begin(); it != pendingSegments.end();) {
+			std::string nameSharedMemory = getNameSharedMemory(it->first);
+			bool isConnected;
+			{
+				std::lock_guard<std::mutex> lock(mutexForSocket);
+				isConnected = audioSenderConnections.find(nameSharedMemory) != audioSenderConnections.end();
+			}
+
+			AudioMemoryHeader header;
+			if (nameSharedMemory.empty() || isConnected || time > it->second + 1000) {
+				it = pendingSegments.erase(it);
+			}
+			else if (SharedMemoryWatcher::peek(it->first, &header, sizeof(header)) && header.isValid()) {
+				connect(nameSharedMemory);
+				it = pendingSegments.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+	// nameSharedMemory of a sender from the name of its memory, empty for memory that isn't a stream
+	static std::string getNameSharedMemory(const std::string& nameSegment) {
+		const std::string prefix = "audioSharing_";
+		if (nameSegment.compare(0, prefix.size(), prefix) != 0 || nameSegment.size() == prefix.size() || nameSegment == "audioSharing_registry") {
+			return "";
+		}
+		// older senders are known by the number only
+		if (nameSegment.find_first_not_of("0123456789", prefix.size()) == std::string::npos) {
+			return nameSegment.substr(prefix.size());
+		}
+		return nameSegment;
+	}
+
+	void receiveAnnouncement(const std::string& data, size_t dataSize) {
+		OSCPP::Server::Message msg(OSCPP::Server::Packet(data.c_str(), dataSize));
+		OSCPP::Server::ArgStream args(msg.args());
+		if (msg != "/memorySharing") {
+			return;
+		}
+		const char* nameSharedMemory = args.string();
+
+		std::lock_guard<std::mutex> lock(mutexForSocket);
+		if (audioSenderConnections.find(nameSharedMemory) != audioSenderConnections.end()) {
+			audioSenderConnections[nameSharedMemory]->updateTime = std::chrono::system_clock::now();
+
+			string name = args.string();
+			int bufferSize = args.int32();
+			int sampleRate = args.int32();
+			int channels = args.int32();
+			int memoryQueueSize = args.int32();
+			int portSend = args.int32();
+
+			if (audioSenderConnections[nameSharedMemory]->portSend != portSend) {
+				audioSenderConnections[nameSharedMemory]->close();
+				audioSenderConnections.erase(audioSenderConnections.find(nameSharedMemory));
+			}
+		}
+		else {
+			AudioReceiverConnection* audioClientConnection = new AudioReceiverConnection();
+			audioClientConnection->updateTime = std::chrono::system_clock::now();
+
+			audioClientConnection->nameSharedMemory = nameSharedMemory;
+			audioClientConnection->name = args.string();
+			audioClientConnection->bufferSize = args.int32();
+			audioClientConnection->sampleRate = args.int32();
+			audioClientConnection->channels = args.int32();
+			audioClientConnection->memoryQueueSize = args.int32();
+			audioClientConnection->portSend = args.int32();
+			// older senders don't announce the layout and the sample format
+			audioClientConnection->layout = args.atEnd() ? AudioLayout::Slots : (AudioLayout)args.int32();
+			audioClientConnection->sampleFormat = args.atEnd() ? AudioSampleFormat::Float32 : (AudioSampleFormat)args.int32();
+
+			setupConnection(audioClientConnection);
+			audioClientConnection->init();
+
+			audioSenderConnections[nameSharedMemory] = audioClientConnection;
+
+			cout << "created nameSharedMemory: " << nameSharedMemory << endl;
+		}
+	}
+
+	void setupConnection(AudioReceiverConnection* audioClientConnection) {
+		audioClientConnection->requiredBufferSizeForQueue = requiredBufferSizeForQueue;
+		audioClientConnection->requiredSampleRate = requiredSampleRate;
+		audioClientConnection->zeroCopyRead = zeroCopyRead;
+		audioClientConnection->spinBeforeWait = spinBeforeWait;
+		audioClientConnection->mirrorRing = mirrorRing;
+		audioClientConnection->hugePages = hugePages;
+		audioClientConnection->lockMemory = lockMemory;
+		audioClientConnection->queueOverflow = queueOverflow;
+		audioClientConnection->driftCompensation = driftCompensation;
+		audioClientConnection->driftTargetFrames = driftTargetFrames;
+		audioClientConnection->settingsReceivedCallback = dataReceivedCallback;
+	}
+};
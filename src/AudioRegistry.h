@@ -0,0 +1,283 @@
+#pragma once
+
+#include "SharedMemory.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+
+const int AUDIOREGISTRY_KEY = 999;
+const int AUDIOREGISTRY_ENTRIES = 1024;
+const uint32_t AUDIOREGISTRY_MAGIC = 0x4752444D; // "MDRG"
+const uint32_t AUDIOREGISTRY_VERSION = 1;
+
+// One stream in the registry. The fields are changed under a seqlock (sequence is odd meanwhile),
+// the heartbeat is updated on its own.
+struct AudioRegistryEntry {
+	enum : uint32_t {
+		Free = 0,
+		Claimed = 1, // being filled by a sender, see getClaimedState
+		Live = 2,
+	};
+
+	// a claimed entry holds the pid of its sender in the state, so one that crashed while filling it can be told
+	static uint32_t getClaimedState(int pid) {
+		return Claimed | ((uint32_t)pid << 2);
+	}
+
+	static bool isClaimedState(uint32_t state) {
+		return (state & 3) == Claimed;
+	}
+
+	uint32_t sequence;
+	uint32_t state;
+	uint64_t heartbeat; // AudioRegistry::getTime() of the last AudioSender::update
+	uint64_t generation; // unique for every add, tells a restarted sender apart from the old one
+	int32_t layout;
+	int32_t format;
+	int32_t channels;
+	int32_t sampleRate;
+	int32_t bufferSize;
+	int32_t memoryQueueSize;
+	int32_t port; // UDP port the sender receives data on
+	int32_t pid;
+	char nameSharedMemory[64];
+	char name[56];
+	char reserved[16];
+
+	void setNames(const std::string& nameSharedMemory, const std::string& name) {
+		memset(this->nameSharedMemory, 0, sizeof(this->nameSharedMemory));
+		strncpy(this->nameSharedMemory, nameSharedMemory.c_str(), sizeof(this->nameSharedMemory) - 1);
+		memset(this->name, 0, sizeof(this->name));
+		strncpy(this->name, name.c_str(), sizeof(this->name) - 1);
+	}
+
+	std::string getNameSharedMemory() {
+		return std::string(nameSharedMemory, strnlen(nameSharedMemory, sizeof(nameSharedMemory)));
+	}
+
+	std::string getName() {
+		return std::string(name, strnlen(name, sizeof(name)));
+	}
+};
+
+static_assert(sizeof(AudioRegistryEntry) == 192, "AudioRegistryEntry is shared between processes, keep its size fixed");
+
+// Well-known shared memory with a lock-free table of the live streams, replaces the UDP announcements:
+// senders add themselves once and then only touch their heartbeat, receivers list the table and
+// sleep on its generation counter until something is added or removed.
+// Memory layout: cache line with magic, version, number of entries, generation counter (futex word),
+// last used generation, number of used entries; cache line with the number of waiting receivers; entries.
+class AudioRegistry {
+	SharedMemoryWriter sharedMemory;
+
+	std::atomic<uint32_t>* getWord(size_t offset) {
+		return reinterpret_cast<std::atomic<uint32_t>*>(sharedMemory.getBuffer() + offset);
+	}
+
+	std::atomic<uint32_t>* getMagic() { return getWord(0); }
+	std::atomic<uint32_t>* getVersion() { return getWord(4); }
+	std::atomic<uint32_t>* getEntriesCount() { return getWord(8); }
+	std::atomic<uint32_t>* getGenerationWord() { return getWord(12); }
+	std::atomic<uint32_t>* getUsedCount() { return getWord(24); }
+	std::atomic<uint32_t>* getWaiters() { return getWord(64); }
+
+	std::atomic<uint64_t>* getLastGeneration() {
+		return reinterpret_cast<std::atomic<uint64_t>*>(sharedMemory.getBuffer() + 16);
+	}
+
+	AudioRegistryEntry* getEntry(int idx) {
+		return reinterpret_cast<AudioRegistryEntry*>(sharedMemory.getBuffer() + getEntriesOffset()) + idx;
+	}
+
+	static std::atomic<uint32_t>* getEntryWord(uint32_t* word) {
+		return reinterpret_cast<std::atomic<uint32_t>*>(word);
+	}
+
+	void notifyChange() {
+		getGenerationWord()->fetch_add(1);
+		if (getWaiters()->load() > 0) {
+			SharedMemoryNotify::wake(getGenerationWord());
+		}
+	}
+
+public:
+	~AudioRegistry() {
+		close();
+	}
+
+	static size_t getEntriesOffset() {
+		return 2 * 64;
+	}
+
+	static size_t getSize() {
+		return getEntriesOffset() + sizeof(AudioRegistryEntry) * AUDIOREGISTRY_ENTRIES;
+	}
+
+	// steady clock milliseconds, comparable between processes on one machine
+	static uint64_t getTime() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// opens the registry, the first process creates it
+	bool init() {
+		if (sharedMemory.isOpened()) {
+			return true;
+		}
+		sharedMemory.exclusive = false;
+		if (!sharedMemory.init("audioSharing_registry", AUDIOREGISTRY_KEY, getSize())) {
+			std::cout << "Error while open the audio registry!" << std::endl;
+			return false;
+		}
+
+		// every process writes the same values, so racing on the first init is harmless
+		if (getMagic()->load(std::memory_order_acquire) != AUDIOREGISTRY_MAGIC) {
+			getVersion()->store(AUDIOREGISTRY_VERSION);
+			getEntriesCount()->store(AUDIOREGISTRY_ENTRIES);
+			getMagic()->store(AUDIOREGISTRY_MAGIC, std::memory_order_release);
+		}
+		if (getVersion()->load() != AUDIOREGISTRY_VERSION || getEntriesCount()->load() != AUDIOREGISTRY_ENTRIES) {
+			std::cout << "The audio registry has an unknown version!" << std::endl;
+			sharedMemory.close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+		sharedMemory.close();
+	}
+
+	bool isOpened() {
+		return sharedMemory.isOpened();
+	}
+
+	// publishes a stream, returns its index or -1 when the registry is full
+	int add(const AudioRegistryEntry& value) {
+		if (!isOpened()) {
+			return -1;
+		}
+		for (int i = 0; i < AUDIOREGISTRY_ENTRIES; i++) {
+			AudioRegistryEntry* entry = getEntry(i);
+			uint32_t claimed = AudioRegistryEntry::getClaimedState(SharedMemoryBase::getProcessId());
+			uint32_t state = AudioRegistryEntry::Free;
+			if (!getEntryWord(&entry->state)->compare_exchange_strong(state, claimed)) {
+				// an entry left by a crashed sender is reused, also one it crashed while filling
+				int pid = AudioRegistryEntry::isClaimedState(state) ? (int)(state >> 2) : state == AudioRegistryEntry::Live ? entry->pid : 0;
+				if (pid <= 0 || SharedMemoryBase::isProcessAlive(pid) || !getEntryWord(&entry->state)->compare_exchange_strong(state, claimed)) {
+					continue;
+				}
+			}
+
+			std::atomic<uint32_t>* sequence = getEntryWord(&entry->sequence);
+			uint32_t s = sequence->load(std::memory_order_relaxed) | 1;
+			sequence->store(s, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			uint64_t generation = getLastGeneration()->fetch_add(1) + 1;
+			memcpy((char*)entry + offsetof(AudioRegistryEntry, layout), (const char*)&value + offsetof(AudioRegistryEntry, layout), sizeof(AudioRegistryEntry) - offsetof(AudioRegistryEntry, layout));
+			entry->generation = generation;
+			reinterpret_cast<std::atomic<uint64_t>*>(&entry->heartbeat)->store(getTime(), std::memory_order_relaxed);
+
+			sequence->store(s + 1, std::memory_order_release);
+			getEntryWord(&entry->state)->store(AudioRegistryEntry::Live, std::memory_order_release);
+
+			uint32_t used = getUsedCount()->load();
+			while (used < (uint32_t)i + 1 && !getUsedCount()->compare_exchange_weak(used, i + 1)) {
+			}
+
+			notifyChange();
+			return i;
+		}
+		std::cout << "The audio registry is full!" << std::endl;
+		return -1;
+	}
+
+	// tells the receivers that the stream at idx is still alive
+	void heartbeat(int idx) {
+		if (isOpened() && idx >= 0) {
+			reinterpret_cast<std::atomic<uint64_t>*>(&getEntry(idx)->heartbeat)->store(getTime(), std::memory_order_relaxed);
+		}
+	}
+
+	// changes the description of the stream at idx, receivers keep their connection (same generation)
+	void update(int idx, const AudioRegistryEntry& value) {
+		if (!isOpened() || idx < 0) {
+			return;
+		}
+		AudioRegistryEntry* entry = getEntry(idx);
+		std::atomic<uint32_t>* sequence = getEntryWord(&entry->sequence);
+		uint32_t s = sequence->load(std::memory_order_relaxed) | 1;
+		sequence->store(s, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy((char*)entry + offsetof(AudioRegistryEntry, layout), (const char*)&value + offsetof(AudioRegistryEntry, layout), sizeof(AudioRegistryEntry) - offsetof(AudioRegistryEntry, layout));
+		sequence->store(s + 1, std::memory_order_release);
+
+		notifyChange();
+	}
+
+	void remove(int idx) {
+		if (!isOpened() || idx < 0) {
+			return;
+		}
+		AudioRegistryEntry* entry = getEntry(idx);
+		std::atomic<uint32_t>* sequence = getEntryWord(&entry->sequence);
+		uint32_t s = sequence->load(std::memory_order_relaxed) | 1;
+		sequence->store(s, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		entry->generation = 0;
+		sequence->store(s + 1, std::memory_order_release);
+		getEntryWord(&entry->state)->store(AudioRegistryEntry::Free, std::memory_order_release);
+
+		notifyChange();
+	}
+
+	// consistent copies of all live entries
+	std::vector<AudioRegistryEntry> list() {
+		std::vector<AudioRegistryEntry> entries;
+		if (!isOpened()) {
+			return entries;
+		}
+		uint32_t used = getUsedCount()->load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < used && i < (uint32_t)AUDIOREGISTRY_ENTRIES; i++) {
+			AudioRegistryEntry* entry = getEntry(i);
+			for (int retry = 0; retry < 3; retry++) {
+				if (getEntryWord(&entry->state)->load(std::memory_order_acquire) != AudioRegistryEntry::Live) {
+					break;
+				}
+				uint32_t s = getEntryWord(&entry->sequence)->load(std::memory_order_acquire);
+				if (s & 1) {
+					continue;
+				}
+				AudioRegistryEntry copy;
+				memcpy(&copy, entry, sizeof(AudioRegistryEntry));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (getEntryWord(&entry->sequence)->load(std::memory_order_relaxed) == s) {
+					copy.heartbeat = reinterpret_cast<std::atomic<uint64_t>*>(&entry->heartbeat)->load(std::memory_order_relaxed);
+					entries.push_back(copy);
+					break;
+				}
+			}
+		}
+		return entries;
+	}
+
+	// changes whenever a stream is added, changed or removed
+	uint32_t getGeneration() {
+		return isOpened() ? getGenerationWord()->load(std::memory_order_acquire) : 0;
+	}
+
+	// sleeps until the generation differs from the given one or timeoutMicros pass
+	void waitForChange(uint32_t generation, int timeoutMicros) {
+		if (!isOpened()) {
+			std::this_thread::sleep_for(std::chrono::microseconds(timeoutMicros));
+			return;
+		}
+		getWaiters()->fetch_add(1);
+		SharedMemoryNotify::wait(getGenerationWord(), generation, timeoutMicros);
+		getWaiters()->fetch_sub(1);
+	}
+};
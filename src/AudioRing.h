@@ -0,0 +1,333 @@
+#pragma once
+
+#include "SharedMemory.h"
+#include "AudioMemoryHeader.h"
+#include "AudioSampleFormat.h"
+
+#include <atomic>
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+
+// Continuous ring of interleaved frames, an alternative to the slots of AudioData: the writer appends any number
+// of frames and readers consume any number, so sender and receiver block sizes are independent.
+// Memory layout: AudioMemoryHeader; cache line written by the writer: 64-bit count of published frames, 64-bit end of
+// the frames being written, 32-bit notify counter; cache line written by readers: number of readers waiting on the
+// notify counter; AUDIOMEMORY_READERS reader positions (AudioMemoryReader); padding up to one page; CAPACITY
+// interleaved frames.
+// The writer doesn't wait for readers unless asked to (AudioRingWriter::flowControl), frames older than CAPACITY
+// are overwritten.
+// The frames are page aligned and CAPACITY is rounded up to whole pages, so the frames can be mapped twice
+// back to back (SharedMemoryBase::setMirroredRange) and then any CAPACITY frames are contiguous in memory.
+// Samples are stored in FORMAT, read and write convert from and to float; the zero-copy paths need Float32.
+class AudioRing {
+public:
+	int CHANNELS;
+	int CAPACITY; // frames
+	int PAGE_SIZE;
+	AudioSampleFormat FORMAT;
+	int FRAME_SIZE; // bytes
+
+	void init(int CHANNELS, int CAPACITY, AudioSampleFormat FORMAT = AudioSampleFormat::Float32) {
+		this->CHANNELS = CHANNELS;
+		this->FORMAT = FORMAT;
+		FRAME_SIZE = AudioSamples::getSize(FORMAT) * CHANNELS;
+		PAGE_SIZE = SharedMemoryBase::getPageSize();
+
+		// smallest number of frames that fills whole pages
+		int a = PAGE_SIZE;
+		int b = FRAME_SIZE;
+		while (b != 0) {
+			int t = a % b;
+			a = b;
+			b = t;
+		}
+		int step = PAGE_SIZE / a;
+		this->CAPACITY = (CAPACITY + step - 1) / step * step;
+	}
+
+	// called by the writer right after the memory is created
+	void writeHeader(char* buf, int sampleRate, int bufferSize, int memoryQueueSize) {
+		AudioMemoryHeader* header = AudioMemoryHeader::get(buf);
+		header->layout = (int)AudioLayout::Ring;
+		header->format = (int)FORMAT;
+		header->channels = CHANNELS;
+		header->sampleRate = sampleRate;
+		header->bufferSize = bufferSize;
+		header->memoryQueueSize = memoryQueueSize;
+		header->size = getSize();
+		header->controlOffset = AudioMemoryHeader::getControlOffset();
+		header->dataOffset = getDataOffset();
+		header->dataStride = CAPACITY;
+		header->publish();
+	}
+
+	// true if the memory was written by a compatible writer with the same layout
+	bool checkHeader(char* buf) {
+		AudioMemoryHeader* header = AudioMemoryHeader::get(buf);
+		return header->isValid() && header->layout == (int)AudioLayout::Ring && header->format == (int)FORMAT && AudioSamples::isValid(header->format) && header->size == getSize() &&
+			header->dataOffset == getDataOffset() && header->dataStride == (uint64_t)CAPACITY;
+	}
+
+	size_t getSize() {
+		return getDataOffset() + (size_t)FRAME_SIZE * CAPACITY;
+	}
+
+	size_t getWriteFrameOffset() {
+		return AudioMemoryHeader::getControlOffset();
+	}
+
+	size_t getWriteEndOffset() {
+		return getWriteFrameOffset() + sizeof(uint64_t);
+	}
+
+	size_t getNotifyOffset() {
+		return getWriteFrameOffset() + 2 * sizeof(uint64_t);
+	}
+
+	size_t getWaitersOffset() {
+		return getWriteFrameOffset() + AUDIOMEMORY_CACHE_LINE;
+	}
+
+	size_t getReadersOffset() {
+		return getWaitersOffset() + AUDIOMEMORY_CACHE_LINE;
+	}
+
+	size_t getDataOffset() {
+		return AudioMemoryHeader::align(getReadersOffset() + AudioMemoryReaders::getSize(), PAGE_SIZE);
+	}
+
+	std::atomic<uint64_t>* getWriteFrame(char* buf) {
+		return reinterpret_cast<std::atomic<uint64_t>*>(buf + getWriteFrameOffset());
+	}
+
+	std::atomic<uint64_t>* getWriteEnd(char* buf) {
+		return reinterpret_cast<std::atomic<uint64_t>*>(buf + getWriteEndOffset());
+	}
+
+	std::atomic<uint32_t>* getNotify(char* buf) {
+		return reinterpret_cast<std::atomic<uint32_t>*>(buf + getNotifyOffset());
+	}
+
+	std::atomic<uint32_t>* getWaiters(char* buf) {
+		return reinterpret_cast<std::atomic<uint32_t>*>(buf + getWaitersOffset());
+	}
+
+	char* getFrame(char* buf, int pos) {
+		return buf + getDataOffset() + (size_t)pos * FRAME_SIZE;
+	}
+};
+
+class AudioRingReader {
+public:
+	uint64_t frameRead = 0; // next frame to read
+	bool isAttached = false;
+	int readerIndex = -1; // entry in the reader positions, -1 when all were taken
+	uint32_t notifyRead = 0;
+	int tornReads = 0;
+	int overrunFrames = 0;
+
+	int getAvailableFrames(SharedMemoryReader& sharedMemoryReader, AudioRing& audioRing) {
+		if (!sharedMemoryReader.isOpened() || !isAttached) {
+			return 0;
+		}
+		uint64_t frameWrite = audioRing.getWriteFrame(sharedMemoryReader.getBuffer())->load(std::memory_order_acquire);
+		return (int)std::min<uint64_t>(frameWrite - frameRead, audioRing.CAPACITY);
+	}
+
+	// copies up to frames interleaved frames to data, returns how many were read
+	int read(SharedMemoryReader& sharedMemoryReader, AudioRing& audioRing, float* data, int frames) {
+		int count = 0;
+		while (count < frames) {
+			int countNext = frames - count;
+			const char* ring = beginReadFrames(sharedMemoryReader, audioRing, countNext);
+			if (ring == nullptr) {
+				break;
+			}
+			AudioSamples::unpack(ring, data + count * audioRing.CHANNELS, (size_t)countNext * audioRing.CHANNELS, audioRing.FORMAT);
+			if (!endRead(sharedMemoryReader, audioRing, countNext)) {
+				break;
+			}
+			count += countNext;
+		}
+		return count;
+	}
+
+	// zero-copy path: returns the next unread frames inside the shared memory or nullptr when there is nothing new,
+	// frames is reduced to the number available (and to the end of the ring when it isn't mirrored).
+	// The data must be consumed before endRead is called. Float32 rings only.
+	const float* beginRead(SharedMemoryReader& sharedMemoryReader, AudioRing& audioRing, int& frames) {
+		if (audioRing.FORMAT != AudioSampleFormat::Float32) {
+			return nullptr;
+		}
+		return (const float*)beginReadFrames(sharedMemoryReader, audioRing, frames);
+	}
+
+	// beginRead for any format, the frames are in audioRing.FORMAT
+	const char* beginReadFrames(SharedMemoryReader& sharedMemoryReader, AudioRing& audioRing, int& frames) {
+		if (!sharedMemoryReader.isOpened()) {
+			return nullptr;
+		}
+		char* buf = sharedMemoryReader.getBuffer();
+
+		notifyRead = audioRing.getNotify(buf)->load(std::memory_order_acquire);
+
+		uint64_t frameWrite = audioRing.getWriteFrame(buf)->load(std::memory_order_acquire);
+		if (!isAttached) {
+			// start with the frames written from now on
+			frameRead = frameWrite;
+			isAttached = true;
+			readerIndex = AudioMemoryReaders::attach(buf, audioRing.getReadersOffset(), frameRead);
+		}
+		if (frameWrite - frameRead > (uint64_t)audioRing.CAPACITY) {
+			// lapped by the writer: continue with the newest frames
+			uint64_t frameNext = frameWrite - std::min(frames, audioRing.CAPACITY);
+			overrunFrames += frameNext - frameRead;
+			frameRead = frameNext;
+		}
+
+		int pos = frameRead % audioRing.CAPACITY;
+		frames = (int)std::min<uint64_t>(frameWrite - frameRead, frames);
+		if (!sharedMemoryReader.isMirrored()) {
+			frames = std::min(frames, audioRing.CAPACITY - pos);
+		}
+		if (frames <= 0) {
+			return nullptr;
+		}
+		return audioRing.getFrame(buf, pos);
+	}
+
+	// returns false if the writer has started to overwrite the frames since beginRead, they are lost then
+	bool endRead(SharedMemoryReader& sharedMemoryReader, AudioRing& audioRing, int frames) {
+		char* buf = sharedMemoryReader.getBuffer();
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t writeEnd = audioRing.getWriteEnd(buf)->load(std::memory_order_relaxed);
+		bool valid = writeEnd <= frameRead + audioRing.CAPACITY;
+		if (!valid) {
+			tornReads++;
+			overrunFrames += frames;
+		}
+
+		frameRead += frames;
+		AudioMemoryReaders::update(buf, audioRing.getReadersOffset(), readerIndex, frameRead, overrunFrames);
+		return valid;
+	}
+
+	// gives the reader position back, call before the memory is closed
+	void detach(SharedMemoryReader& sharedMemoryReader, AudioRing& audioRing) {
+		if (sharedMemoryReader.isOpened()) {
+			AudioMemoryReaders::detach(sharedMemoryReader.getBuffer(), audioRing.getReadersOffset(), readerIndex);
+		}
+		readerIndex = -1;
+		isAttached = false;
+	}
+
+	// call when read returned nothing: spins spinCount times, then sleeps until the writer
+	// publishes new frames or timeoutMicros pass
+	void waitForData(SharedMemoryReader& sharedMemoryReader, AudioRing& audioRing, int timeoutMicros, int spinCount = 0) {
+		if (!sharedMemoryReader.isOpened()) {
+			std::this_thread::sleep_for(std::chrono::microseconds(timeoutMicros));
+			return;
+		}
+		char* buf = sharedMemoryReader.getBuffer();
+		std::atomic<uint32_t>* notify = audioRing.getNotify(buf);
+		AudioMemoryReaders::heartbeat(buf, audioRing.getReadersOffset(), readerIndex);
+
+		for (int i = 0; i < spinCount; i++) {
+			if (notify->load(std::memory_order_acquire) != notifyRead) {
+				return;
+			}
+			std::this_thread::yield();
+		}
+
+		std::atomic<uint32_t>* waiters = audioRing.getWaiters(buf);
+		waiters->fetch_add(1);
+		SharedMemoryNotify::wait(notify, notifyRead, timeoutMicros);
+		waiters->fetch_sub(1);
+	}
+};
+
+class AudioRingWriter {
+public:
+	uint64_t frameWrite = 0;
+	bool flowControl = false; // never overwrite frames an active reader hasn't read yet, write less instead
+
+	// frames not yet consumed by the slowest active reader
+	int getQueuedFrames(SharedMemoryWriter& sharedMemoryWriter, AudioRing& audioRing, int* readersCount = nullptr) {
+		if (!sharedMemoryWriter.isOpened()) {
+			return 0;
+		}
+		uint64_t lag = AudioMemoryReaders::getSlowestLag(sharedMemoryWriter.getBuffer(), audioRing.getReadersOffset(), frameWrite, readersCount);
+		return (int)std::min<uint64_t>(lag, audioRing.CAPACITY);
+	}
+
+	// appends frames interleaved frames, returns how many were written
+	int write(SharedMemoryWriter& sharedMemoryWriter, AudioRing& audioRing, const float* data, int frames) {
+		// only the newest CAPACITY frames fit
+		if (frames > audioRing.CAPACITY) {
+			data += (frames - audioRing.CAPACITY) * audioRing.CHANNELS;
+			frames = audioRing.CAPACITY;
+		}
+
+		int count = 0;
+		while (count < frames) {
+			int countNext = frames - count;
+			char* ring = beginWriteFrames(sharedMemoryWriter, audioRing, countNext);
+			if (ring == nullptr) {
+				break;
+			}
+			AudioSamples::pack(data + count * audioRing.CHANNELS, ring, (size_t)countNext * audioRing.CHANNELS, audioRing.FORMAT);
+			commitWrite(sharedMemoryWriter, audioRing, countNext);
+			count += countNext;
+		}
+		return count;
+	}
+
+	// zero-copy path: returns where the next frames go inside the shared memory, frames is reduced to what fits
+	// (up to the end of the ring when it isn't mirrored), fill them and call commitWrite. Float32 rings only.
+	float* beginWrite(SharedMemoryWriter& sharedMemoryWriter, AudioRing& audioRing, int& frames) {
+		if (audioRing.FORMAT != AudioSampleFormat::Float32) {
+			return nullptr;
+		}
+		return (float*)beginWriteFrames(sharedMemoryWriter, audioRing, frames);
+	}
+
+	// beginWrite for any format, the frames go in audioRing.FORMAT
+	char* beginWriteFrames(SharedMemoryWriter& sharedMemoryWriter, AudioRing& audioRing, int& frames) {
+		if (!sharedMemoryWriter.isOpened()) {
+			return nullptr;
+		}
+		char* buf = sharedMemoryWriter.getBuffer();
+
+		int pos = frameWrite % audioRing.CAPACITY;
+		frames = std::min(frames, sharedMemoryWriter.isMirrored() ? audioRing.CAPACITY : audioRing.CAPACITY - pos);
+		if (flowControl) {
+			frames = std::min(frames, audioRing.CAPACITY - getQueuedFrames(sharedMemoryWriter, audioRing));
+			if (frames <= 0) {
+				return nullptr;
+			}
+		}
+
+		// announce the frames that are about to be overwritten before touching them
+		audioRing.getWriteEnd(buf)->store(frameWrite + frames, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		return audioRing.getFrame(buf, pos);
+	}
+
+	void commitWrite(SharedMemoryWriter& sharedMemoryWriter, AudioRing& audioRing, int frames) {
+		if (!sharedMemoryWriter.isOpened()) {
+			return;
+		}
+		char* buf = sharedMemoryWriter.getBuffer();
+
+		frameWrite += frames;
+		audioRing.getWriteFrame(buf)->store(frameWrite, std::memory_order_release);
+
+		audioRing.getNotify(buf)->fetch_add(1);
+		if (audioRing.getWaiters(buf)->load() > 0) {
+			SharedMemoryNotify::wake(audioRing.getNotify(buf));
+		}
+	}
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIOSAMPLEFORMAT_SSE2
+#endif
+#if defined __F16C__
+#include <immintrin.h>
+#define AUDIOSAMPLEFORMAT_F16C
+#endif
+
+// how samples are stored in the shared memory (AudioMemoryHeader::format), readers always get 32-bit float
+enum class AudioSampleFormat : int {
+	Float32 = 0,
+	Int16 = 1, // half the memory traffic, -1..1 scaled to 32767
+	Int24 = 2, // 3 bytes little endian, -1..1 scaled to 8388607
+	Float16 = 3, // IEEE half precision
+};
+
+// Conversion between float and the compact formats. Out of range samples are clipped for the integer formats.
+// SSE2 (and F16C when the compiler targets it) is used where available, the plain loops are written so the
+// compiler can vectorize them.
+class AudioSamples {
+public:
+	static int getSize(AudioSampleFormat format) {
+		switch (format) {
+		case AudioSampleFormat::Int16: return 2;
+		case AudioSampleFormat::Int24: return 3;
+		case AudioSampleFormat::Float16: return 2;
+		default: return 4;
+		}
+	}
+
+	static bool isValid(int format) {
+		return format >= (int)AudioSampleFormat::Float32 && format <= (int)AudioSampleFormat::Float16;
+	}
+
+	// count samples from src to dst in format
+	static void pack(const float* src, char* dst, size_t count, AudioSampleFormat format) {
+		switch (format) {
+		case AudioSampleFormat::Int16: packInt16(src, dst, count); break;
+		case AudioSampleFormat::Int24: packInt24(src, dst, count); break;
+		case AudioSampleFormat::Float16: packFloat16(src, dst, count); break;
+		default: memcpy(dst, src, sizeof(float) * count); break;
+		}
+	}
+
+	// count samples in format from src to dst
+	static void unpack(const char* src, float* dst, size_t count, AudioSampleFormat format) {
+		switch (format) {
+		case AudioSampleFormat::Int16: unpackInt16(src, dst, count); break;
+		case AudioSampleFormat::Int24: unpackInt24(src, dst, count); break;
+		case AudioSampleFormat::Float16: unpackFloat16(src, dst, count); break;
+		default: memcpy(dst, src, sizeof(float) * count); break;
+		}
+	}
+
+	static uint16_t toHalf(float value) {
+		uint32_t x;
+		memcpy(&x, &value, sizeof(x));
+		uint32_t sign = (x >> 16) & 0x8000;
+		uint32_t abs = x & 0x7FFFFFFF;
+		if (abs >= 0x7F800000) {
+			// infinity, NaN stays NaN
+			return (uint16_t)(sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 : 0));
+		}
+		if (abs >= 0x477FF000) {
+			// rounds to more than the biggest half
+			return (uint16_t)(sign | 0x7C00);
+		}
+		if (abs < 0x38800000) {
+			// subnormal half, rounded to nearest even
+			if (abs < 0x33000000) {
+				return (uint16_t)sign;
+			}
+			uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+			int shift = 126 - (int)(abs >> 23);
+			uint32_t half = mantissa >> shift;
+			uint32_t rest = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1))) {
+				half++;
+			}
+			return (uint16_t)(sign | half);
+		}
+		// rebias the exponent and round the mantissa to nearest even
+		uint32_t rounded = abs - 0x38000000 + 0xFFF + ((abs >> 13) & 1);
+		return (uint16_t)(sign | (rounded >> 13));
+	}
+
+	static float fromHalf(uint16_t half) {
+		uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1F;
+		uint32_t mantissa = half & 0x3FF;
+		uint32_t x;
+		if (exponent == 0) {
+			float value = mantissa * (1.0f / 16777216.0f);
+			return sign ? -value : value;
+		}
+		if (exponent == 31) {
+			x = sign | 0x7F800000 | (mantissa << 13);
+		}
+		else {
+			x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		float value;
+		memcpy(&value, &x, sizeof(value));
+		return value;
+	}
+
+private:
+	static void packInt16(const float* src, char* dst, size_t count) {
+		size_t i = 0;
+#if defined AUDIOSAMPLEFORMAT_SSE2
+		// clip, then round to nearest
+		const __m128 scale = _mm_set1_ps(32767.0f);
+		const __m128 low = _mm_set1_ps(-1.0f);
+		const __m128 high = _mm_set1_ps(1.0f);
+		for (; i + 8 <= count; i += 8) {
+			__m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), low), high), scale));
+			__m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), low), high), scale));
+			_mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_packs_epi32(a, b));
+		}
+#endif
+		for (; i < count; i++) {
+			float value = std::min(std::max(src[i], -1.0f), 1.0f) * 32767.0f;
+			int16_t sample = (int16_t)(value < 0 ? value - 0.5f : value + 0.5f);
+			memcpy(dst + 2 * i, &sample, 2);
+		}
+	}
+
+	static void unpackInt16(const char* src, float* dst, size_t count) {
+		size_t i = 0;
+#if defined AUDIOSAMPLEFORMAT_SSE2
+		const __m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+		for (; i + 8 <= count; i += 8) {
+			__m128i samples = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+			// sign extend by shifting the samples into the upper half of 32 bits
+			__m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+			__m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+			_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+		}
+#endif
+		for (; i < count; i++) {
+			int16_t sample;
+			memcpy(&sample, src + 2 * i, 2);
+			dst[i] = sample * (1.0f / 32767.0f);
+		}
+	}
+
+	static void packInt24(const float* src, char* dst, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			float value = std::min(std::max(src[i], -1.0f), 1.0f) * 8388607.0f;
+			int32_t sample = (int32_t)(value < 0 ? value - 0.5f : value + 0.5f);
+			dst[3 * i] = (char)(sample & 0xFF);
+			dst[3 * i + 1] = (char)((sample >> 8) & 0xFF);
+			dst[3 * i + 2] = (char)((sample >> 16) & 0xFF);
+		}
+	}
+
+	static void unpackInt24(const char* src, float* dst, size_t count) {
+		const uint8_t* bytes = (const uint8_t*)src;
+		for (size_t i = 0; i < count; i++) {
+			// the top byte goes to the top of 32 bits, shifting back sign extends
+			int32_t sample = (int32_t)(((uint32_t)bytes[3 * i] << 8) | ((uint32_t)bytes[3 * i + 1] << 16) | ((uint32_t)bytes[3 * i + 2] << 24)) >> 8;
+			dst[i] = sample * (1.0f / 8388607.0f);
+		}
+	}
+
+	static void packFloat16(const float* src, char* dst, size_t count) {
+		size_t i = 0;
+#if defined AUDIOSAMPLEFORMAT_F16C
+		for (; i + 8 <= count; i += 8) {
+			_mm_storeu_si128((__m128i*)(dst + 2 * i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+		}
+#endif
+		for (; i < count; i++) {
+			uint16_t half = toHalf(src[i]);
+			memcpy(dst + 2 * i, &half, 2);
+		}
+	}
+
+	static void unpackFloat16(const char* src, float* dst, size_t count) {
+		size_t i = 0;
+#if defined AUDIOSAMPLEFORMAT_F16C
+		for (; i + 8 <= count; i += 8) {
+			_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + 2 * i))));
+		}
+#endif
+		for (; i < count; i++) {
+			uint16_t half;
+			memcpy(&half, src + 2 * i, 2);
+			dst[i] = fromHalf(half);
+		}
+	}
+};
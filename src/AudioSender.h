@@ -1,6 +1,9 @@
 #pragma once
 
 #include "AudioData.h"
+#include "AudioRing.h"
+#include "AudioRegistry.h"
+#include "AudioArena.h"
 #include "SharedMemory.h"
 
 #include "oscpp/server.hpp"
@@ -8,6 +11,8 @@
 #include "UDPsocket.h"
 
 #include <thread>
+#include <mutex>
+#include <atomic>
 #include <chrono>
 #include <ctime>  
 
@@ -20,9 +25,31 @@ class AudioSender {
 	SharedMemoryWriter sharedMemoryWriter;
 	AudioData audioData;
 	AudioDataWriter audioDataWriter;
+	AudioRing audioRing;
+	AudioRingWriter audioRingWriter;
+	AudioRegistry registry;
+	int registryIndex = -1;
+	uint32_t formatGeneration = 0; // of the memory, see updateFormat
+
+	// The format being written, copied from the public fields by init and updateFormat. After init only
+	// the audio thread changes it (under mutexFormat), so the write functions read it without a lock.
+	struct Format {
+		int bufferSize;
+		int sampleRate;
+		int channels;
+		int memoryQueueSize;
+		AudioLayout layout;
+		AudioSampleFormat sampleFormat;
+	};
+	Format format = Format();
+	Format pendingFormat = Format(); // requested by updateFormat, under mutexFormat
+	std::atomic<bool> isFormatPending{ false };
+	std::mutex mutexFormat;
 
 	std::thread threadSocket;
 
+	float* writePointer = nullptr;
+
 
 	bool isRunning;
 
@@ -35,6 +62,14 @@ public:
 	int	sampleRate;
 	int channels;
 	int memoryQueueSize;
+	AudioLayout layout = AudioLayout::Slots;
+	AudioSampleFormat sampleFormat = AudioSampleFormat::Float32; // how AudioLayout::Ring stores samples, Int16 halves the memory traffic; Slots always stores Float32, init warns
+	bool mirrorRing = true; // map the ring twice so it never wraps (Linux)
+	bool hugePages = false; // back the memory with transparent huge pages if possible (Linux)
+	bool lockMemory = false; // keep the memory in RAM for real-time use, see isMemoryLocked
+	bool flowControl = false; // don't overwrite what an active receiver hasn't read yet, writing fails instead
+	bool broadcast = true; // also announce over UDP, for receivers without the registry (older versions)
+	AudioArena* arena = nullptr; // publish inside this arena instead of an own memory, it has to outlive the sender
 	int portReceive = -1;
 	int portSend = -1;
 
@@ -50,37 +85,210 @@ public:
         return isRunning;
     }
 
+	// not while the audio thread writes, use updateFormat then
 	void init() {
-		close();
+		init(getRequestedFormat());
+	}
 
-		socket.open();
-		for (int i = PORT_MEMORYSHARING + 1; i < PORT_MEMORYSHARING + 1000; i++) {
-			if (socket.bind(i) == (int)UDPsocket::Status::OK) {
-				portReceive = i;
-				break;
+	// Applies changed bufferSize, sampleRate, channels, memoryQueueSize, layout or sampleFormat without dropping
+	// the receivers: the memory is recreated under the same name and the old one is marked with an odd format
+	// generation, so receivers finish its last block and switch over keeping their threads. Streams in an arena
+	// and Windows, where the name can't be reused right away, fall back to close and init.
+	// Can be called from any thread: the fields are copied now and the switch is done by the audio thread at
+	// the start of its next getDataPointer, beginWrite, writeFrames or beginWriteFrames, so no write goes to
+	// the old memory. That call takes the time of recreating the memory (over 100 ms with the fallback).
+	void updateFormat() {
+		if (!isRunning) {
+			init();
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutexFormat);
+		pendingFormat = getRequestedFormat();
+		isFormatPending.store(true, std::memory_order_release);
+	}
+
+	void update() {
+		std::lock_guard<std::mutex> lock(mutexFormat);
+		if (isRunning && sharedMemoryWriter.isOpened()) {
+			registry.heartbeat(registryIndex);
+		}
+		if (isRunning && sharedMemoryWriter.isOpened() && (broadcast || registryIndex < 0)) {
+			std::vector<char> buffer(1024 * 2);
+			OSCPP::Client::Packet packet(buffer.data(), buffer.size());
+			packet.
+				openMessage("/memorySharing", 9).
+				string(nameSharedMemory.c_str()).
+				string(name.c_str()).
+				int32(format.bufferSize).
+				int32(format.sampleRate).
+				int32(format.channels).
+				int32(format.memoryQueueSize).
+				int32(portReceive).
+				int32((int)format.layout).
+				int32((int)audioRing.FORMAT).
+				closeMessage();
+			buffer.resize(packet.size());
+
+			if (socketBroadcast.send(buffer, UDPsocket::IPv4::Loopback(PORT_MEMORYSHARING)) == (int)UDPsocket::Status::SendError) {
+				std::cout << "socket broadcast send error" << std::endl;
+			}
+			// cout << "nameSharedMemory: " << nameSharedMemory << endl;
+		}
+	}
+	
+	// frames the slowest active receiver is behind, 0 without receivers; readersCount gets the number of active receivers.
+	// Receivers that haven't read for a second (paused or gone) don't count.
+	int getSlowestReaderLag(int* readersCount = nullptr) {
+		std::lock_guard<std::mutex> lock(mutexFormat);
+		if (format.layout == AudioLayout::Ring) {
+			return audioRingWriter.getQueuedFrames(sharedMemoryWriter, audioRing, readersCount);
+		}
+		return audioDataWriter.getQueuedBlocks(sharedMemoryWriter, audioData, readersCount) * format.bufferSize;
+	}
+
+	// audio thread: the format written right now, it follows updateFormat at the next beginWrite or writeFrames
+	int getCurrentBufferSize() {
+		return format.bufferSize;
+	}
+
+	int getCurrentChannels() {
+		return format.channels;
+	}
+
+	// false without lockMemory or if locking failed, usually RLIMIT_MEMLOCK (ulimit -l) is too low then
+	bool isMemoryLocked() {
+		return sharedMemoryWriter.isLocked();
+	}
+
+	// AudioLayout::Slots only, nullptr otherwise
+	float* getDataPointer() {
+		applyPendingFormat();
+		if (format.layout != AudioLayout::Slots) {
+			return nullptr;
+		}
+		return audioData.getDataPointer();
+	}
+
+	void writeData() {
+		if (format.layout == AudioLayout::Slots) {
+			audioDataWriter.writeToMemory(sharedMemoryWriter, audioData);
+		}
+	}
+
+	// Zero-copy alternative to getDataPointer/writeData: returns the next slot inside
+	// the shared memory (channels * bufferSize floats, channel after channel).
+	// nullptr with flowControl while the slowest receiver still has to read that slot,
+	// and unless the layout is AudioLayout::Slots.
+	float* beginWrite() {
+		applyPendingFormat();
+		if (format.layout != AudioLayout::Slots) {
+			return nullptr;
+		}
+		writePointer = audioDataWriter.beginWrite(sharedMemoryWriter, audioData);
+		return writePointer;
+	}
+
+	// frames - number of frames written per channel, the rest of the slot is cleared
+	void commitWrite(int frames) {
+		if (writePointer == nullptr || format.layout != AudioLayout::Slots) {
+			return;
+		}
+		if (frames < format.bufferSize) {
+			for (int c = 0; c < format.channels; c++) {
+				memset(writePointer + c * format.bufferSize + frames, 0, sizeof(float) * (format.bufferSize - frames));
+			}
+		}
+		audioDataWriter.commitWrite(sharedMemoryWriter, audioData);
+		writePointer = nullptr;
+	}
+
+	// AudioLayout::Ring only: appends any number of interleaved frames
+	bool writeFrames(const float* data, int frames) {
+		applyPendingFormat();
+		if (format.layout != AudioLayout::Ring) {
+			return false;
+		}
+		return audioRingWriter.write(sharedMemoryWriter, audioRing, data, frames) == frames;
+	}
+
+	// AudioLayout::Ring only, zero-copy: returns where the next interleaved frames go inside the shared memory,
+	// frames is reduced to what is contiguous there (always all of them when the ring is mirrored).
+	// nullptr unless sampleFormat is Float32, use writeFrames then
+	float* beginWriteFrames(int& frames) {
+		applyPendingFormat();
+		if (format.layout != AudioLayout::Ring) {
+			return nullptr;
+		}
+		return audioRingWriter.beginWrite(sharedMemoryWriter, audioRing, frames);
+	}
+
+	void commitWriteFrames(int frames) {
+		if (format.layout == AudioLayout::Ring) {
+			audioRingWriter.commitWrite(sharedMemoryWriter, audioRing, frames);
+		}
+	}
+
+	void sendData(std::string str) {
+		if (portSend < 0 || socket.send(str, UDPsocket::IPv4::Loopback(portSend)) == (int)UDPsocket::Status::SendError) {
+			std::cout << "socket send error" << std::endl;
+		}
+	}
+
+	void close() {
+		if (isRunning) {
+			isRunning = false;
+			registry.remove(registryIndex);
+			registryIndex = -1;
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+			if (arena != nullptr) {
+				arena->release(sharedMemoryWriter);
 			}
+			sharedMemoryWriter.close();
+			socketBroadcast.close();
+			socket.close();
 		}
+	}
+
+private:
+	Format getRequestedFormat() {
+		if (layout != AudioLayout::Ring && sampleFormat != AudioSampleFormat::Float32) {
+			std::cout << "The slots layout always stores Float32, sampleFormat needs AudioLayout::Ring!" << std::endl;
+		}
+		return { bufferSize, sampleRate, channels, memoryQueueSize, layout, layout == AudioLayout::Ring ? sampleFormat : AudioSampleFormat::Float32 };
+	}
 
-		audioData.init(bufferSize * channels, memoryQueueSize);
+	void init(const Format& format) {
+		close();
+		this->format = format;
+		isFormatPending = false;
+
+		socket.open();
+		uint16_t port = 0;
+		portReceive = socket.bind_any(port) == (int)UDPsocket::Status::OK ? port : -1;
+
+		size_t size = setupFormat();
+		formatGeneration = 0;
 
 		socketBroadcast.open();
 		socketBroadcast.broadcast(true);
 
-		for (int c = 1000; c < 5000; c++) {
-			if (sharedMemoryWriter.init("audioSharing_" + std::to_string(c), c, audioData.getSize())) {
-#ifdef TARGET_WIN32
-				nameSharedMemory = "audioSharing_" + ofToString(c);
-#else
-				nameSharedMemory = std::to_string(c);
-#endif
-				break;
-			}
+		if (arena != nullptr) {
+			nameSharedMemory = arena->allocate((int)size, sharedMemoryWriter);
+		}
+		else {
+			sharedMemoryWriter.initUnique(size, nameSharedMemory);
 		}
-        
+
         if(!sharedMemoryWriter.isOpened()) {
             cout << std::string("Error while open memory sharing for write!") << endl;
             throw std::exception();
         }
+		writeHeader();
+
+		if (registry.init()) {
+			registryIndex = registry.add(getRegistryEntry());
+		}
 
 		isRunning = true;
 
@@ -108,52 +316,85 @@ public:
 
 	}
 
-	void update() {
-		if (isRunning && sharedMemoryWriter.isOpened()) {
-			std::vector<char> buffer(1024 * 2);
-			OSCPP::Client::Packet packet(buffer.data(), buffer.size());
-			packet.
-				openMessage("/memorySharing", 7).
-				string(nameSharedMemory.c_str()).
-				string(name.c_str()).
-				int32(bufferSize).
-				int32(sampleRate).
-				int32(channels).
-				int32(memoryQueueSize).
-				int32(portReceive).
-				closeMessage();
-			buffer.resize(packet.size());
+	// audio thread: switches to the format requested by updateFormat, unless update holds the lock right now
+	void applyPendingFormat() {
+		if (!isFormatPending.load(std::memory_order_acquire) || !mutexFormat.try_lock()) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutexFormat, std::adopt_lock);
+		isFormatPending.store(false, std::memory_order_relaxed);
+		Format next = pendingFormat;
+#if defined _WIN32 || defined _WIN64
+		bool canRecreate = false;
+#else
+		bool canRecreate = true;
+#endif
+		if (!sharedMemoryWriter.isOpened() || arena != nullptr || !canRecreate) {
+			init(next);
+			return;
+		}
 
-			if (socketBroadcast.send(buffer, UDPsocket::IPv4::Loopback(PORT_MEMORYSHARING)) == (int)UDPsocket::Status::SendError) {
-				std::cout << "socket broadcast send error" << std::endl;
-			}
-			// cout << "nameSharedMemory: " << nameSharedMemory << endl;
+		// the old layout is still described by the header
+		char* buf = sharedMemoryWriter.getBuffer();
+		AudioMemoryHeader* header = AudioMemoryHeader::get(buf);
+		std::atomic<uint32_t>* notify = (AudioLayout)header->layout == AudioLayout::Ring ? audioRing.getNotify(buf) : audioData.getNotify(buf);
+		reinterpret_cast<std::atomic<uint32_t>*>(&header->formatGeneration)->store(formatGeneration + 1, std::memory_order_release);
+		notify->fetch_add(1);
+		SharedMemoryNotify::wake(notify);
+		formatGeneration += 2;
+
+		format = next;
+		size_t size = setupFormat();
+		if (!sharedMemoryWriter.reinit((int)size, nameSharedMemory)) {
+			init(next);
+			return;
 		}
-	}
-	
-	float* getDataPointer() {
-		return audioData.getDataPointer();
+		writeHeader();
+		registry.update(registryIndex, getRegistryEntry());
 	}
 
-	void writeData() {
-		audioDataWriter.writeToMemory(sharedMemoryWriter, audioData);
+	// prepares the layout for the current format, returns the size of the memory
+	size_t setupFormat() {
+		audioData.init(format.bufferSize * format.channels, format.memoryQueueSize, format.layout == AudioLayout::Slots);
+		audioRing.init(format.channels, format.bufferSize * format.memoryQueueSize, format.sampleFormat);
+		audioRingWriter = AudioRingWriter();
+		audioRingWriter.flowControl = flowControl;
+		audioDataWriter = AudioDataWriter();
+		audioDataWriter.flowControl = flowControl;
+		writePointer = nullptr;
+		sharedMemoryWriter.setMirroredRange(format.layout == AudioLayout::Ring && mirrorRing ? audioRing.getDataOffset() : -1);
+		sharedMemoryWriter.setHugePages(hugePages);
+		sharedMemoryWriter.setLocked(lockMemory);
+		return format.layout == AudioLayout::Ring ? audioRing.getSize() : audioData.getSize();
 	}
 
-	void sendData(std::string str) {
-		if (portSend < 0 || socket.send(str, UDPsocket::IPv4::Loopback(portSend)) == (int)UDPsocket::Status::SendError) {
-			std::cout << "socket send error" << std::endl;
+	// describe the stream in the memory itself, receivers can attach without the announcement
+	void writeHeader() {
+		AudioMemoryHeader* header = AudioMemoryHeader::get(sharedMemoryWriter.getBuffer());
+		header->setName(name);
+		header->port = portReceive;
+		header->pid = SharedMemoryBase::getProcessId();
+		header->formatGeneration = formatGeneration;
+		if (format.layout == AudioLayout::Ring) {
+			audioRing.writeHeader(sharedMemoryWriter.getBuffer(), format.sampleRate, format.bufferSize, format.memoryQueueSize);
+		}
+		else {
+			audioData.writeHeader(sharedMemoryWriter.getBuffer(), format.channels, format.sampleRate);
 		}
 	}
 
-	void close() {
-		if (isRunning) {
-			isRunning = false;
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-			sharedMemoryWriter.close();
-			socketBroadcast.close();
-			socket.close();
-		}
+	AudioRegistryEntry getRegistryEntry() {
+		AudioRegistryEntry entry = AudioRegistryEntry();
+		entry.setNames(nameSharedMemory, name);
+		entry.layout = (int)format.layout;
+		entry.format = (int)audioRing.FORMAT;
+		entry.channels = format.channels;
+		entry.sampleRate = format.sampleRate;
+		entry.bufferSize = format.bufferSize;
+		entry.memoryQueueSize = format.memoryQueueSize;
+		entry.port = portReceive;
+		entry.pid = SharedMemoryBase::getProcessId();
+		return entry;
 	}
 };
 
@@ -5,14 +5,64 @@
 #include <windows.h>
 #elif defined __APPLE__
 #include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <err.h>
+#elif defined __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <signal.h>
+#include <dirent.h>
+#include <linux/futex.h>
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+// Wait for / wake on a 32-bit word placed inside a shared mapping. On Linux this is a (process shared) futex,
+// on other platforms waiting falls back to sleeping for the timeout.
+class SharedMemoryNotify {
+public:
+	// blocks while the word equals expected, but not longer than timeoutMicros
+	static void wait(std::atomic<uint32_t>* word, uint32_t expected, int timeoutMicros) {
+#if defined __linux__
+		struct timespec timeout;
+		timeout.tv_sec = timeoutMicros / 1000000;
+		timeout.tv_nsec = (timeoutMicros % 1000000) * 1000;
+		syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, &timeout, NULL, 0);
+#else
+		if (word->load(std::memory_order_acquire) == expected) {
+			std::this_thread::sleep_for(std::chrono::microseconds(timeoutMicros));
+		}
+#endif
+	}
+
+	static void wake(std::atomic<uint32_t>* word) {
+#if defined __linux__
+		syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#endif
+	}
+};
 
 class SharedMemoryBase {
 protected:
@@ -20,9 +70,127 @@ protected:
 	HANDLE hMemory = INVALID_HANDLE_VALUE;
 #elif defined __APPLE__
 	int sharedMemId = -1;
+#elif defined __linux__
+	int fd = -1;
+	std::string posixName;
+
+	int mirrorOffset = -1;
+	int sizeMirror = 0;
+
+	bool hugePages = false;
+	bool isHugePagesAdvised = false;
+
+	// POSIX shm names must start with a single slash; without a name the key is used like on macOS
+	static std::string getPosixName(const std::string& name, int key) {
+		return "/" + (name.empty() ? "audioSharing_" + std::to_string(key) : name);
+	}
+
+	// maps fd to buf, with a mirrored range [mirrorOffset, sizeMemory) is mapped a second time right after the end
+	bool mapFile() {
+		// MAP_POPULATE prefaults the pages here instead of in the first audio callback,
+		// with huge pages that has to wait until they are advised (prefault)
+		int flags = MAP_SHARED | (hugePages ? 0 : MAP_POPULATE);
+		int pageSize = getPageSize();
+		sizeMirror = 0;
+		if (mirrorOffset > 0 && mirrorOffset < sizeMemory && mirrorOffset % pageSize == 0 && (sizeMemory - mirrorOffset) % pageSize == 0) {
+			sizeMirror = sizeMemory - mirrorOffset;
+		}
+
+		if (sizeMirror == 0) {
+			void* ptr = mmap(NULL, sizeMemory, PROT_READ | PROT_WRITE, flags, fd, 0);
+			if (ptr == MAP_FAILED) {
+				std::cout << "mmap error: " << strerror(errno) << std::endl;
+				return false;
+			}
+			buf = (char*)ptr;
+			prefault();
+			return true;
+		}
+
+		// reserve address space for both views first, then put the file over it
+		void* ptr = mmap(NULL, sizeMemory + sizeMirror, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED) {
+			std::cout << "mmap error: " << strerror(errno) << std::endl;
+			sizeMirror = 0;
+			return false;
+		}
+		char* base = (char*)ptr;
+		if (mmap(base, sizeMemory, PROT_READ | PROT_WRITE, flags | MAP_FIXED, fd, 0) == MAP_FAILED ||
+			mmap(base + sizeMemory, sizeMirror, PROT_READ | PROT_WRITE, flags | MAP_FIXED, fd, mirrorOffset) == MAP_FAILED) {
+			std::cout << "mmap mirror error: " << strerror(errno) << std::endl;
+			munmap(base, sizeMemory + sizeMirror);
+			sizeMirror = 0;
+			return false;
+		}
+		buf = base;
+		prefault();
+		return true;
+	}
+
+	// with hugePages asks for transparent huge pages, then faults all pages in. Huge pages only back whole
+	// aligned 2 MiB blocks and need shmem_enabled set to advise (or always) in /sys/kernel/mm/transparent_hugepage,
+	// otherwise the normal pages are used.
+	void prefault() {
+		isHugePagesAdvised = false;
+		if (!hugePages) {
+			return;
+		}
+		size_t size = sizeMemory + sizeMirror;
+		isHugePagesAdvised = madvise(buf, size, MADV_HUGEPAGE) == 0;
+#if defined MADV_POPULATE_WRITE
+		if (madvise(buf, size, MADV_POPULATE_WRITE) == 0) {
+			return;
+		}
+#endif
+		int pageSize = getPageSize();
+		for (size_t i = 0; i < size; i += pageSize) {
+			(void)*(volatile char*)(buf + i);
+		}
+	}
+
+	void unmapFile() {
+		munmap(buf, sizeMemory + sizeMirror);
+		buf = nullptr;
+		sizeMirror = 0;
+	}
 #endif
 	int sizeMemory = 0;
 	char* buf = nullptr;
+	bool isView = false; // buf belongs to another memory, see initView
+
+	bool locked = false;
+	bool isPagesLocked = false;
+
+	// with setLocked faults all pages in and keeps them in RAM, so the audio threads never wait for a page fault
+	void lockPages() {
+		isPagesLocked = false;
+		if (!locked || buf == nullptr) {
+			return;
+		}
+		size_t size = sizeMemory;
+#if defined __linux__
+		size += sizeMirror;
+#endif
+#if defined _WIN32 || defined _WIN64
+		// locked pages count against the working set
+		SIZE_T sizeMin, sizeMax;
+		if (GetProcessWorkingSetSize(GetCurrentProcess(), &sizeMin, &sizeMax)) {
+			SetProcessWorkingSetSize(GetCurrentProcess(), sizeMin + size, sizeMax + size);
+		}
+		isPagesLocked = VirtualLock(buf, size) != 0;
+		if (!isPagesLocked) {
+			std::cout << "VirtualLock error: " << GetLastError() << std::endl;
+		}
+#else
+		isPagesLocked = mlock(buf, size) == 0;
+		if (!isPagesLocked) {
+			int error = errno;
+			struct rlimit limit;
+			getrlimit(RLIMIT_MEMLOCK, &limit);
+			std::cout << "mlock error: " << strerror(error) << ", RLIMIT_MEMLOCK is " << limit.rlim_cur << " bytes, " << size << " are needed" << std::endl;
+		}
+#endif
+	}
 
 public:
 
@@ -32,10 +200,225 @@ public:
 	virtual void update(char* data) = 0;
 	virtual void update(char* data, int offset, int size) = 0;
 	virtual bool isOpened() = 0;
+
+	// direct access to the mapping, nullptr when not opened
+	char* getBuffer() {
+		return buf;
+	}
+
+	int getSize() {
+		return sizeMemory;
+	}
+
+	// makes this a window of size bytes at offset into memory, which keeps owning the mapping
+	// and has to stay open meanwhile; close only forgets the window then
+	void initView(SharedMemoryBase& memory, size_t offset, int size) {
+		close();
+		buf = memory.getBuffer() + offset;
+		sizeMemory = size;
+		isView = true;
+		isPagesLocked = memory.isLocked();
+	}
+
+	// Linux only, call before init: maps [offset, size) once more right after the end of the memory, so a ring
+	// placed there can be accessed across its end without wrapping. offset and size have to be page aligned.
+	void setMirroredRange(int offset) {
+#if defined __linux__
+		mirrorOffset = offset;
+#endif
+	}
+
+	// Linux only, call before init: back the memory with transparent huge pages when the system allows it,
+	// saves TLB misses on big memories (many channels, deep queues)
+	void setHugePages(bool value) {
+#if defined __linux__
+		hugePages = value;
+#endif
+	}
+
+	// true if huge pages back at least part of the memory, otherwise the normal pages are used (no huge pages free,
+	// shmem_enabled, a memory smaller than one). Reads /proc/self/smaps, not for the audio thread.
+	bool isHugePages() {
+#if defined __linux__
+		if (buf == nullptr || !isHugePagesAdvised) {
+			return false;
+		}
+		FILE* smaps = fopen("/proc/self/smaps", "r");
+		if (smaps == nullptr) {
+			return false;
+		}
+		unsigned long long begin = (uintptr_t)buf, end = begin + sizeMemory + sizeMirror;
+		bool isInRange = false, isBacked = false;
+		char line[512];
+		while (!isBacked && fgets(line, sizeof(line), smaps)) {
+			unsigned long long from, to, kb;
+			if (sscanf(line, "%llx-%llx ", &from, &to) == 2) {
+				isInRange = from < end && to > begin;
+			}
+			else if (isInRange && (sscanf(line, "ShmemPmdMapped: %llu kB", &kb) == 1 || sscanf(line, "FilePmdMapped: %llu kB", &kb) == 1 ||
+				sscanf(line, "AnonHugePages: %llu kB", &kb) == 1)) {
+				isBacked = kb > 0;
+			}
+		}
+		fclose(smaps);
+		return isBacked;
+#else
+		return false;
+#endif
+	}
+
+	// call before init: lock the memory in RAM for real-time use, see isLocked.
+	// On Linux and macOS the limit is RLIMIT_MEMLOCK (ulimit -l), on Windows the working set.
+	void setLocked(bool value) {
+		locked = value;
+	}
+
+	// true if the memory is locked in RAM; false if setLocked wasn't asked for it or locking failed, it is used unlocked then
+	bool isLocked() {
+		return buf != nullptr && isPagesLocked;
+	}
+
+	// true if the range set with setMirroredRange was mapped twice
+	bool isMirrored() {
+#if defined __linux__
+		return buf != nullptr && sizeMirror > 0;
+#else
+		return false;
+#endif
+	}
+
+	static int getPageSize() {
+#if defined _WIN32 || defined _WIN64
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return (int)sysconf(_SC_PAGESIZE);
+#endif
+	}
+
+	static int getProcessId() {
+#if defined _WIN32 || defined _WIN64
+		return (int)GetCurrentProcessId();
+#else
+		return (int)getpid();
+#endif
+	}
+
+	// false only if the process surely doesn't exist, pid 0 means unknown
+	static bool isProcessAlive(int pid) {
+		if (pid <= 0) {
+			return true;
+		}
+#if defined _WIN32 || defined _WIN64
+		HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+		if (process == NULL) {
+			return GetLastError() == ERROR_ACCESS_DENIED;
+		}
+		DWORD exitCode = 0;
+		bool result = GetExitCodeProcess(process, &exitCode) && exitCode == STILL_ACTIVE;
+		CloseHandle(process);
+		return result;
+#else
+#if defined __linux__ && defined SYS_pidfd_open
+		// unlike kill, a pidfd also sees an exited process that wasn't reaped yet
+		int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+		if (pidfd >= 0) {
+			struct pollfd pfd = { pidfd, POLLIN, 0 };
+			bool result = poll(&pfd, 1, 0) == 0;
+			::close(pidfd);
+			return result;
+		}
+		if (errno == ESRCH) {
+			return false;
+		}
+#endif
+		return kill(pid, 0) == 0 || errno == EPERM;
+#endif
+	}
+
+	// name no other memory of this machine has, so creating it succeeds at the first try
+	static std::string getUniqueName(const std::string& prefix) {
+		static std::atomic<int> counter(0);
+		return prefix + std::to_string(getProcessId()) + "_" + std::to_string(counter++);
+	}
 };
 
 class SharedMemoryWriter : public SharedMemoryBase {
 public:
+	// false - open the memory if it already exists and keep it when closing, for memory shared by many writers
+	bool exclusive = true;
+
+	// Linux only: removes memory named by getUniqueName(prefix) whose process is gone, it is left behind by a crash
+	static void removeStale(const std::string& prefix) {
+#if defined __linux__
+		DIR* dir = opendir("/dev/shm");
+		if (dir == NULL) {
+			return;
+		}
+		while (struct dirent* entry = readdir(dir)) {
+			std::string name = entry->d_name;
+			if (name.compare(0, prefix.size(), prefix) != 0) {
+				continue;
+			}
+			char* end = nullptr;
+			int pid = (int)strtol(name.c_str() + prefix.size(), &end, 10);
+			if (*end == '_' && pid > 0 && pid != getProcessId() && !isProcessAlive(pid)) {
+				shm_unlink(("/" + name).c_str());
+			}
+		}
+		closedir(dir);
+#endif
+	}
+
+	// creates memory under a name no one uses yet and returns it in nameSharedMemory
+	// (a number on macOS, where System V memory has no names)
+	bool initUnique(int size, std::string& nameSharedMemory) {
+#if defined __APPLE__
+		// start probing at a key derived from the process
+		int keyFirst = getProcessId() % 4000;
+		for (int i = 0; i < 4000; i++) {
+			int c = 1000 + (keyFirst + i) % 4000;
+			if (init("audioSharing_" + std::to_string(c), c, size)) {
+				nameSharedMemory = std::to_string(c);
+				return true;
+			}
+		}
+#else
+		static bool isStaleRemoved = false;
+		if (!isStaleRemoved) {
+			removeStale("audioSharing_");
+			isStaleRemoved = true;
+		}
+
+		// a stale memory of a crashed process with the same id may still be there
+		for (int i = 0; i < 10; i++) {
+			std::string nameUnique = getUniqueName("audioSharing_");
+			if (init(nameUnique, 0, size)) {
+				nameSharedMemory = nameUnique;
+				return true;
+			}
+		}
+#endif
+		return false;
+	}
+
+	// replaces the memory returned by initUnique with a new one of another size under the same name,
+	// readers keep the old one mapped until they open the name again
+	bool reinit(int size, const std::string& nameSharedMemory) {
+#if defined _WIN32 || defined _WIN64
+		// a mapping lives while any process has it open, the name can't be used again before
+		return false;
+#else
+		close();
+		if (!nameSharedMemory.empty() && nameSharedMemory.find_first_not_of("0123456789") == std::string::npos) {
+			int key = std::stoi(nameSharedMemory);
+			return init("audioSharing_" + nameSharedMemory, key, size);
+		}
+		return init(nameSharedMemory, 0, size);
+#endif
+	}
+
 	bool init(std::string name, int key, int size) override {
 		this->sizeMemory = size;
 
@@ -59,6 +442,14 @@ public:
 				return false;
 			}
 		} 
+		else if (!exclusive) {
+			buf = (char*)MapViewOfFile(hMemory, FILE_MAP_ALL_ACCESS, 0, 0, sizeMemory);
+			if (buf == NULL) {
+				std::cout << "Could not map view of file: " << GetLastError() << std::endl;
+				CloseHandle(hMemory);
+				return false;
+			}
+		}
 		else {
 			std::cout << "Memory is already open" << strerror(errno) << std::endl;
 			CloseHandle(hMemory);
@@ -67,7 +458,7 @@ public:
 
 #elif defined __APPLE__
 		key_t k = ftok("/tmp/", key);
-		sharedMemId = shmget(k, sizeMemory, IPC_CREAT | IPC_EXCL | 0666);
+		sharedMemId = shmget(k, sizeMemory, exclusive ? IPC_CREAT | IPC_EXCL | 0666 : IPC_CREAT | 0666);
 		if (sharedMemId == -1) {
             std::cout << "shmget error: " << std::endl;
 			return false;
@@ -80,7 +471,36 @@ public:
 			buf = nullptr;
 			return false;
 		}
+#elif defined __linux__
+		posixName = getPosixName(name, key);
+		fd = shm_open(posixName.c_str(), exclusive ? O_CREAT | O_EXCL | O_RDWR : O_CREAT | O_RDWR, 0666);
+		if (fd == -1) {
+			if (errno != EEXIST) {
+				std::cout << "shm_open error: " << strerror(errno) << std::endl;
+			}
+			return false;
+		}
+		fchmod(fd, 0666);
+		struct stat st;
+		if (fstat(fd, &st) == -1 || (st.st_size < sizeMemory && ftruncate(fd, sizeMemory) == -1)) {
+			std::cout << "ftruncate error: " << strerror(errno) << std::endl;
+			::close(fd);
+			if (exclusive) {
+				shm_unlink(posixName.c_str());
+			}
+			fd = -1;
+			return false;
+		}
+		if (!mapFile()) {
+			::close(fd);
+			if (exclusive) {
+				shm_unlink(posixName.c_str());
+			}
+			fd = -1;
+			return false;
+		}
 #endif
+		lockPages();
 		return true;
 	}
 
@@ -105,6 +525,11 @@ public:
 	}
 
 	void close() override {
+		if (isView) {
+			buf = nullptr;
+			isView = false;
+			return;
+		}
 #if defined _WIN32 || defined _WIN64
 		if (buf != nullptr) {
 			UnmapViewOfFile(buf);
@@ -116,19 +541,40 @@ public:
 		}
 #elif defined __APPLE__
 		if (sharedMemId != -1) {
-			shmctl(sharedMemId, IPC_RMID, NULL);
+			if (exclusive) {
+				shmctl(sharedMemId, IPC_RMID, NULL);
+			}
 			sharedMemId = -1;
 		}
 		if (buf != nullptr) {
             shmdt(buf);
 			buf = nullptr;
 		}
+#elif defined __linux__
+		if (buf != nullptr) {
+			unmapFile();
+		}
+		if (fd != -1) {
+			::close(fd);
+			if (exclusive) {
+				shm_unlink(posixName.c_str());
+			}
+			fd = -1;
+		}
 #endif
 	}
 };
 
 class SharedMemoryReader : public SharedMemoryBase {
 public:
+	// opens memory by the name SharedMemoryWriter::initUnique returned, numbers are keys (macOS and older writers)
+	bool open(const std::string& nameSharedMemory, int size) {
+		if (nameSharedMemory.empty() || nameSharedMemory.find_first_not_of("0123456789") != std::string::npos) {
+			return init(nameSharedMemory, 0, size);
+		}
+		return init("", std::stoi(nameSharedMemory), size);
+	}
+
 	bool init(std::string name, int key, int size) override {
 		this->sizeMemory = size;
 
@@ -164,7 +610,27 @@ public:
 			buf = nullptr;
 			return false;
 		}
+#elif defined __linux__
+		posixName = getPosixName(name, key);
+		fd = shm_open(posixName.c_str(), O_RDWR, 0666);
+		if (fd == -1) {
+			std::cout << "shm_open error: " << strerror(errno) << std::endl;
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) == -1 || st.st_size < sizeMemory) {
+			std::cout << "shared memory is smaller than expected: " << posixName << std::endl;
+			::close(fd);
+			fd = -1;
+			return false;
+		}
+		if (!mapFile()) {
+			::close(fd);
+			fd = -1;
+			return false;
+		}
 #endif
+		lockPages();
 		return true;
 	}
 
@@ -189,6 +655,11 @@ public:
 	}
 
 	void close() override {
+		if (isView) {
+			buf = nullptr;
+			isView = false;
+			return;
+		}
 #if defined _WIN32 || defined _WIN64
 		if (buf != nullptr) {
 			UnmapViewOfFile(buf);
@@ -207,8 +678,171 @@ public:
             shmdt(buf);
             buf = nullptr;
         }
+#elif defined __linux__
+		if (buf != nullptr) {
+			unmapFile();
+		}
+		if (fd != -1) {
+			::close(fd);
+			fd = -1;
+		}
 #endif
 	}
 };
 
+// Reports shared memory being created and removed, so readers can attach and detach right away.
+// Linux only (inotify on /dev/shm), on other platforms init returns false.
+class SharedMemoryWatcher {
+#if defined __linux__
+	int fd = -1;
+#endif
+
+public:
+	struct Event {
+		std::string name; // as passed to SharedMemoryBase::init
+		bool created; // false - removed
+	};
 
+	~SharedMemoryWatcher() {
+		close();
+	}
+
+	bool init() {
+#if defined __linux__
+		if (fd >= 0) {
+			return true;
+		}
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0) {
+			std::cout << "inotify_init1 error: " << strerror(errno) << std::endl;
+			return false;
+		}
+		if (inotify_add_watch(fd, "/dev/shm", IN_CREATE | IN_DELETE) < 0) {
+			std::cout << "inotify_add_watch error: " << strerror(errno) << std::endl;
+			close();
+			return false;
+		}
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void close() {
+#if defined __linux__
+		if (fd >= 0) {
+			::close(fd);
+			fd = -1;
+		}
+#endif
+	}
+
+	bool isOpened() {
+#if defined __linux__
+		return fd >= 0;
+#else
+		return false;
+#endif
+	}
+
+	// waits up to timeoutMillis for the first change and returns all changes seen since the last call,
+	// otherFd - also returns once it can be read (e.g. a socket), isOtherReady tells if it can
+	std::vector<Event> wait(int timeoutMillis, int otherFd = -1, bool* isOtherReady = nullptr) {
+		std::vector<Event> events;
+		if (isOtherReady) {
+			*isOtherReady = false;
+		}
+#if defined __linux__
+		if (fd < 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMillis));
+			return events;
+		}
+		// poll skips a negative fd
+		struct pollfd pfd[2] = { { fd, POLLIN, 0 }, { otherFd, POLLIN, 0 } };
+		if (poll(pfd, 2, timeoutMillis) <= 0) {
+			return events;
+		}
+		if (isOtherReady) {
+			*isOtherReady = (pfd[1].revents & POLLIN) != 0;
+		}
+		if (!(pfd[0].revents & POLLIN)) {
+			return events;
+		}
+
+		alignas(struct inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+			for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len) {
+				struct inotify_event* event = (struct inotify_event*)ptr;
+				if (event->len > 0) {
+					events.push_back({ event->name, (event->mask & IN_CREATE) != 0 });
+				}
+			}
+		}
+#else
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMillis));
+#endif
+		return events;
+	}
+
+	// reads the first bytes of the memory without mapping it, false if it doesn't exist or is smaller
+	static bool peek(const std::string& name, void* data, size_t size) {
+#if defined __linux__
+		int fdMemory = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+		if (fdMemory < 0) {
+			return false;
+		}
+		bool result = pread(fdMemory, data, size, 0) == (ssize_t)size;
+		::close(fdMemory);
+		return result;
+#else
+		return false;
+#endif
+	}
+};
+
+// Tells if the process owning a memory still runs. On Linux a pidfd is polled, so a reused pid can't fool it,
+// elsewhere the pid is checked.
+class SharedMemoryOwner {
+	int pid = 0;
+#if defined __linux__
+	int pidfd = -1;
+#endif
+
+public:
+	~SharedMemoryOwner() {
+		close();
+	}
+
+	// pid 0 - unknown, isAlive always returns true then
+	void init(int pid) {
+		close();
+		this->pid = pid;
+#if defined __linux__ && defined SYS_pidfd_open
+		if (pid > 0) {
+			pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+		}
+#endif
+	}
+
+	void close() {
+#if defined __linux__
+		if (pidfd >= 0) {
+			::close(pidfd);
+			pidfd = -1;
+		}
+#endif
+		pid = 0;
+	}
+
+	bool isAlive() {
+#if defined __linux__
+		if (pidfd >= 0) {
+			// the pidfd becomes readable when the process exits
+			struct pollfd pfd = { pidfd, POLLIN, 0 };
+			return poll(&pfd, 1, 0) == 0;
+		}
+#endif
+		return SharedMemoryBase::isProcessAlive(pid);
+	}
+};
@@ -40,6 +40,7 @@
 #pragma once
 
 #include <cmath>
+#include <stdint.h>
 
 namespace speexport {
   enum {
@@ -232,13 +233,11 @@ namespace speexport {
   }
 
   static int multiply_frac(spx_uint32_t* result, spx_uint32_t value, spx_uint32_t num, spx_uint32_t den) {
-    spx_uint32_t major = value / den;
-    spx_uint32_t remain = value % den;
-    /* TODO: Could use 64 bits operation to check for overflow. But only guaranteed in C99+ */
-    if (remain > 4294967295U / num || major > 4294967295U / num
-      || major * num > 4294967295U - remain * num / den)
+    /* 64 bits, the fine ratios of the drift compensation overflow 32 bits */
+    uint64_t product = (uint64_t)value * num / den;
+    if (product > 4294967295U)
       return RESAMPLER_ERR_OVERFLOW;
-    *result = remain * num / den + major * num;
+    *result = (spx_uint32_t)product;
     return RESAMPLER_ERR_SUCCESS;
   }
 
@@ -829,6 +828,25 @@ namespace speexport {
     int init(spx_uint32_t nb_channels, spx_uint32_t rate_in, spx_uint32_t rate_out, int quality, int* err) {
       int filter_err;
       SpeexResampler* st = this;
+
+      /* Calling init again starts over, e.g. with another number of channels */
+      speex_free(st->mem);
+      speex_free(st->sinc_table);
+      speex_free(st->last_sample);
+      speex_free(st->magic_samples);
+      speex_free(st->samp_frac_num);
+      st->mem = nullptr;
+      st->sinc_table = nullptr;
+      st->last_sample = nullptr;
+      st->magic_samples = nullptr;
+      st->samp_frac_num = nullptr;
+      st->mem_alloc_size = 0;
+      st->sinc_table_length = 0;
+      st->filt_len = 0;
+      st->quality = -1;
+      st->initialised = 0;
+      st->started = 0;
+
       st->nb_channels = nb_channels;
 
 
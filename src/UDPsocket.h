@@ -118,6 +118,7 @@ public:
 	}
 
 	bool is_closed() const { return sock < 0; }
+	int get_handle() const { return sock; }
 
 public:
 	int bind(const IPv4& ipaddr)
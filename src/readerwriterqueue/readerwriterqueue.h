@@ -13,6 +13,7 @@
 #include <new>
 #include <cstdint>
 #include <cstdlib>		// For malloc/free/abort & size_t
+#include <cstring>		// For memcpy
 #include <memory>
 #if __cplusplus > 199711L || _MSC_VER >= 1700 // C++11 or VS2012
 #include <chrono>
@@ -474,6 +475,136 @@ public:
 		return true;
 	}
 	
+	// Enqueues copies of up to count elements from items if there is room
+	// in the queue. Contiguous runs within a block are copied at once and the
+	// block's tail is published once per run, instead of once per element.
+	// Returns the number of elements enqueued.
+	// Does not allocate memory.
+	size_t try_enqueue_bulk(T const* items, size_t count) AE_NO_TSAN
+	{
+#ifndef NDEBUG
+		ReentrantGuard guard(this->enqueuing);
+#endif
+		// See inner_enqueue() for reasoning
+
+		size_t enqueued = 0;
+		while (enqueued != count) {
+			Block* tailBlock_ = tailBlock.load();
+			size_t blockFront = tailBlock_->localFront;
+			size_t blockTail = tailBlock_->tail.load();
+
+			// One slot always stays empty
+			size_t room = (blockFront - blockTail - 1) & tailBlock_->sizeMask;
+			if (room < count - enqueued) {
+				blockFront = tailBlock_->localFront = tailBlock_->front.load();
+				room = (blockFront - blockTail - 1) & tailBlock_->sizeMask;
+			}
+			if (room != 0) {
+				fence(memory_order_acquire);
+				size_t n = room < count - enqueued ? room : count - enqueued;
+				copy_to_block(tailBlock_, blockTail, items + enqueued, n);
+
+				fence(memory_order_release);
+				tailBlock_->tail = (blockTail + n) & tailBlock_->sizeMask;
+				enqueued += n;
+				continue;
+			}
+
+			fence(memory_order_acquire);
+			if (tailBlock_->next.load() == frontBlock) {
+				// Would have had to allocate a new block to enqueue the rest
+				break;
+			}
+			fence(memory_order_acquire);
+
+			// tailBlock is full, but there's a free block ahead, fill it before moving on to it
+			Block* tailBlockNext = tailBlock_->next.load();
+			size_t nextBlockFront = tailBlockNext->localFront = tailBlockNext->front.load();
+			size_t nextBlockTail = tailBlockNext->tail.load();
+			fence(memory_order_acquire);
+
+			assert(nextBlockFront == nextBlockTail);
+			AE_UNUSED(nextBlockFront);
+
+			size_t n = tailBlockNext->sizeMask < count - enqueued ? tailBlockNext->sizeMask : count - enqueued;
+			copy_to_block(tailBlockNext, nextBlockTail, items + enqueued, n);
+			tailBlockNext->tail = (nextBlockTail + n) & tailBlockNext->sizeMask;
+
+			fence(memory_order_release);
+			tailBlock = tailBlockNext;
+			enqueued += n;
+		}
+		return enqueued;
+	}
+
+	// Dequeues up to max elements to result, moving them with operator=.
+	// Runs within a block are taken at once and the block's front is
+	// published once per run, instead of once per element.
+	// Returns the number of elements dequeued, 0 if the queue appeared empty.
+	template<typename U>
+	size_t try_dequeue_bulk(U* result, size_t max) AE_NO_TSAN
+	{
+		return inner_dequeue_bulk(result, max);
+	}
+
+	// Like peek(), but also sets count to the number of elements that follow
+	// the front element contiguously in memory (up to the end of its block).
+	// They stay in the queue; remove them with pop_bulk(count) when done.
+	// Returns nullptr (and count 0) if the queue appeared empty.
+	// Must be called only from the consumer thread.
+	T* peek_range(size_t& count) const AE_NO_TSAN
+	{
+#ifndef NDEBUG
+		ReentrantGuard guard(this->dequeuing);
+#endif
+		// See try_dequeue() for reasoning
+
+		count = 0;
+		Block* frontBlock_ = frontBlock.load();
+		size_t blockTail = frontBlock_->localTail;
+		size_t blockFront = frontBlock_->front.load();
+
+		if (blockFront != blockTail || blockFront != (frontBlock_->localTail = frontBlock_->tail.load())) {
+			// localTail may have just been refreshed from tail
+			blockTail = frontBlock_->localTail;
+			fence(memory_order_acquire);
+		non_empty_front_block:
+			count = blockTail > blockFront ? blockTail - blockFront : frontBlock_->sizeMask + 1 - blockFront;
+			return reinterpret_cast<T*>(frontBlock_->data + blockFront * sizeof(T));
+		}
+		else if (frontBlock_ != tailBlock.load()) {
+			fence(memory_order_acquire);
+			frontBlock_ = frontBlock.load();
+			blockTail = frontBlock_->localTail = frontBlock_->tail.load();
+			blockFront = frontBlock_->front.load();
+			fence(memory_order_acquire);
+
+			if (blockFront != blockTail) {
+				goto non_empty_front_block;
+			}
+
+			Block* nextBlock = frontBlock_->next;
+
+			size_t nextBlockFront = nextBlock->front.load();
+			size_t nextBlockTail = nextBlock->tail.load();
+			fence(memory_order_acquire);
+
+			assert(nextBlockFront != nextBlockTail);
+			count = nextBlockTail > nextBlockFront ? nextBlockTail - nextBlockFront : nextBlock->sizeMask + 1 - nextBlockFront;
+			return reinterpret_cast<T*>(nextBlock->data + nextBlockFront * sizeof(T));
+		}
+
+		return nullptr;
+	}
+
+	// Removes up to count elements from the front of the queue without
+	// returning them, e.g. after peek_range().
+	// Returns the number of elements removed.
+	size_t pop_bulk(size_t count) AE_NO_TSAN
+	{
+		return inner_dequeue_bulk(static_cast<T*>(nullptr), count);
+	}
+
 	// Returns the approximate number of items currently in the queue.
 	// Safe to call from both the producer and consumer threads.
 	inline size_t size_approx() const AE_NO_TSAN
@@ -630,6 +761,72 @@ private:
 	}
 
 
+	// Moves the elements to result unless it's nullptr, then they are only destroyed
+	template<typename U>
+	size_t inner_dequeue_bulk(U* result, size_t max) AE_NO_TSAN
+	{
+#ifndef NDEBUG
+		ReentrantGuard guard(this->dequeuing);
+#endif
+		// See try_dequeue() for reasoning
+
+		size_t dequeued = 0;
+		while (dequeued != max) {
+			Block* frontBlock_ = frontBlock.load();
+			size_t blockTail = frontBlock_->localTail;
+			size_t blockFront = frontBlock_->front.load();
+
+			if (blockFront != blockTail || blockFront != (frontBlock_->localTail = frontBlock_->tail.load())) {
+				if (((blockTail - blockFront) & frontBlock_->sizeMask) < max - dequeued) {
+					// The producer may have added more since localTail was read
+					blockTail = frontBlock_->localTail = frontBlock_->tail.load();
+				}
+				fence(memory_order_acquire);
+			}
+			else if (frontBlock_ != tailBlock.load()) {
+				fence(memory_order_acquire);
+
+				frontBlock_ = frontBlock.load();
+				blockTail = frontBlock_->localTail = frontBlock_->tail.load();
+				blockFront = frontBlock_->front.load();
+				fence(memory_order_acquire);
+
+				if (blockFront == blockTail) {
+					// Front block is empty but there's another block ahead, advance to it
+					Block* nextBlock = frontBlock_->next;
+
+					size_t nextBlockFront = nextBlock->front.load();
+					size_t nextBlockTail = nextBlock->localTail = nextBlock->tail.load();
+					fence(memory_order_acquire);
+
+					assert(nextBlockFront != nextBlockTail);
+
+					fence(memory_order_release);
+					frontBlock = frontBlock_ = nextBlock;
+
+					compiler_fence(memory_order_release);
+
+					blockFront = nextBlockFront;
+					blockTail = nextBlockTail;
+				}
+			}
+			else {
+				// No elements in current block and no other block to advance to
+				break;
+			}
+
+			size_t available = (blockTail - blockFront) & frontBlock_->sizeMask;
+			size_t n = available < max - dequeued ? available : max - dequeued;
+			move_from_block(frontBlock_, blockFront, result == nullptr ? nullptr : result + dequeued, n,
+				std::integral_constant<bool, std::is_same<U, T>::value && std::is_trivially_copyable<T>::value>());
+
+			fence(memory_order_release);
+			frontBlock_->front = (blockFront + n) & frontBlock_->sizeMask;
+			dequeued += n;
+		}
+		return dequeued;
+	}
+
 	// Disable copying
 	ReaderWriterQueue(ReaderWriterQueue const&) {  }
 
@@ -726,6 +923,57 @@ private:
 		return new (newBlockAligned) Block(capacity, newBlockRaw, newBlockData);
 	}
 
+	// Constructs count copies of items in block starting at index, wrapping around its end
+	static void copy_to_block(Block* block, size_t index, T const* items, size_t count) AE_NO_TSAN
+	{
+		size_t first = block->sizeMask + 1 - index;
+		if (first > count) {
+			first = count;
+		}
+		construct_range(block->data + index * sizeof(T), items, first, std::is_trivially_copyable<T>());
+		construct_range(block->data, items + first, count - first, std::is_trivially_copyable<T>());
+	}
+
+	static AE_FORCEINLINE void construct_range(char* location, T const* items, size_t count, std::true_type) AE_NO_TSAN
+	{
+		std::memcpy(location, items, count * sizeof(T));
+	}
+
+	static void construct_range(char* location, T const* items, size_t count, std::false_type) AE_NO_TSAN
+	{
+		for (size_t i = 0; i != count; ++i) {
+			new (location + i * sizeof(T)) T(items[i]);
+		}
+	}
+
+	// Moves count elements starting at index out of block to result (unless it's nullptr) and destroys them,
+	// wrapping around its end
+	template<typename U>
+	static void move_from_block(Block* block, size_t index, U* result, size_t count, std::true_type) AE_NO_TSAN
+	{
+		if (result == nullptr) {
+			return;
+		}
+		size_t first = block->sizeMask + 1 - index;
+		if (first > count) {
+			first = count;
+		}
+		std::memcpy(result, block->data + index * sizeof(T), first * sizeof(T));
+		std::memcpy(result + first, block->data, (count - first) * sizeof(T));
+	}
+
+	template<typename U>
+	static void move_from_block(Block* block, size_t index, U* result, size_t count, std::false_type) AE_NO_TSAN
+	{
+		for (size_t i = 0; i != count; ++i) {
+			auto element = reinterpret_cast<T*>(block->data + ((index + i) & block->sizeMask) * sizeof(T));
+			if (result != nullptr) {
+				result[i] = std::move(*element);
+			}
+			element->~T();
+		}
+	}
+
 private:
 	weak_atomic<Block*> frontBlock;		// (Atomic) Elements are dequeued from this block
 	
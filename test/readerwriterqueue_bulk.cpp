@@ -0,0 +1,171 @@
+// Checks the bulk operations of ReaderWriterQueue against the per-element ones, exits with 1 on a mismatch.
+// g++ -std=c++11 -O2 -I../src readerwriterqueue_bulk.cpp -o readerwriterqueue_bulk -lpthread
+
+#include "readerwriterqueue/readerwriterqueue.h"
+
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace moodycamel;
+
+int failures = 0;
+
+void check(bool condition, const char* what, int step) {
+	if (!condition) {
+		printf("failed: %s (step %d)\n", what, step);
+		failures++;
+	}
+}
+
+// a peek_range after the producer moved on from an empty peek must see the new elements only
+void checkPeekAfterEmpty() {
+	ReaderWriterQueue<int> queue(15);
+	int value;
+	for (int i = 0; i < 5; i++) {
+		queue.enqueue(i);
+		queue.try_dequeue(value);
+	}
+	size_t count;
+	check(queue.peek_range(count) == nullptr && count == 0, "peek_range of an empty queue", 0);
+	queue.enqueue(10);
+	queue.enqueue(11);
+	int* front = queue.peek_range(count);
+	check(front != nullptr && count == 2 && count <= queue.size_approx(), "peek_range count", 0);
+	check(front != nullptr && front[0] == 10 && front[1] == 11, "peek_range values", 0);
+}
+
+// random single and bulk operations on one thread, compared with a std::deque
+template<typename T, typename Make>
+void checkRandom(size_t size, Make make) {
+	ReaderWriterQueue<T> queue(size);
+	std::deque<T> expected;
+	std::mt19937 random(1);
+	std::vector<T> buffer(size * 2);
+	int next = 0;
+	for (int step = 0; step < 200000 && !failures; step++) {
+		size_t count = 1 + random() % (size * 2);
+		switch (random() % 6) {
+		case 0: {
+			T value = make(next);
+			if (queue.try_enqueue(value)) {
+				expected.push_back(value);
+				next++;
+			}
+			break;
+		}
+		case 1: {
+			for (size_t i = 0; i < count; i++) {
+				buffer[i] = make(next + (int)i);
+			}
+			size_t n = queue.try_enqueue_bulk(buffer.data(), count);
+			check(n <= count, "try_enqueue_bulk count", step);
+			expected.insert(expected.end(), buffer.begin(), buffer.begin() + n);
+			next += (int)n;
+			break;
+		}
+		case 2: {
+			T value;
+			bool dequeued = queue.try_dequeue(value);
+			check(dequeued == !expected.empty(), "try_dequeue", step);
+			if (dequeued && !expected.empty()) {
+				check(value == expected.front(), "try_dequeue value", step);
+				expected.pop_front();
+			}
+			break;
+		}
+		case 3: {
+			size_t n = queue.try_dequeue_bulk(buffer.data(), count);
+			check(n == std::min(count, expected.size()), "try_dequeue_bulk count", step);
+			for (size_t i = 0; i < n && !expected.empty(); i++) {
+				check(buffer[i] == expected.front(), "try_dequeue_bulk value", step);
+				expected.pop_front();
+			}
+			break;
+		}
+		case 4: {
+			size_t n;
+			T* front = queue.peek_range(n);
+			check((front != nullptr) == !expected.empty() && n <= expected.size(), "peek_range count", step);
+			for (size_t i = 0; i < n && i < expected.size(); i++) {
+				check(front[i] == expected[i], "peek_range value", step);
+			}
+			n = std::min(n, count);
+			check(queue.pop_bulk(n) == n, "pop_bulk count", step);
+			expected.erase(expected.begin(), expected.begin() + std::min(n, expected.size()));
+			break;
+		}
+		case 5: {
+			T* front = queue.peek();
+			check((front != nullptr) == !expected.empty(), "peek", step);
+			if (front != nullptr && !expected.empty()) {
+				check(*front == expected.front(), "peek value", step);
+			}
+			break;
+		}
+		}
+		check(queue.size_approx() == expected.size(), "size_approx", step);
+	}
+}
+
+// bulk producer and consumer on two threads, the consumer sees every element once and in order
+void checkThreads() {
+	ReaderWriterQueue<int> queue(1000);
+	const int total = 1000000;
+	std::thread producer([&]() {
+		std::mt19937 random(2);
+		std::vector<int> buffer(700);
+		int next = 0;
+		while (next < total) {
+			int count = std::min(1 + (int)(random() % 700), total - next);
+			for (int i = 0; i < count; i++) {
+				buffer[i] = next + i;
+			}
+			size_t n = queue.try_enqueue_bulk(buffer.data(), count);
+			if (n == 0) {
+				std::this_thread::yield();
+			}
+			next += (int)n;
+		}
+	});
+	std::mt19937 random(3);
+	std::vector<int> buffer(1024); // a peek_range run can be a whole block
+	int expected = 0;
+	bool ordered = true;
+	while (expected < total) {
+		size_t n;
+		if (random() % 2) {
+			n = queue.try_dequeue_bulk(buffer.data(), 1 + random() % 900);
+		}
+		else {
+			int* front = queue.peek_range(n);
+			if (front != nullptr) {
+				std::copy(front, front + n, buffer.begin());
+			}
+			queue.pop_bulk(n);
+		}
+		if (n == 0) {
+			std::this_thread::yield();
+		}
+		for (size_t i = 0; i < n; i++) {
+			ordered = ordered && buffer[i] == expected;
+			expected++;
+		}
+	}
+	producer.join();
+	check(ordered, "order across threads", 0);
+}
+
+int main() {
+	checkPeekAfterEmpty();
+	for (size_t size : { 15, 100, 1000, 5000 }) {
+		checkRandom<int>(size, [](int i) { return i; });
+	}
+	checkRandom<std::string>(100, [](int i) { return std::to_string(i); });
+	checkThreads();
+	printf(failures ? "FAILED\n" : "OK\n");
+	return failures ? 1 : 0;
+}